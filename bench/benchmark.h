@@ -0,0 +1,72 @@
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <scratchcloudclient/log.h>
+
+namespace scratchcloud::bench
+{
+
+/*! Prevents the compiler from optimizing away the given value. */
+template<typename T>
+inline void doNotOptimize(const T &value)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : : "r,m"(value) : "memory");
+#else
+    static volatile const void *sink;
+    sink = &value;
+#endif
+}
+
+/*! Hides the informational messages of the library while it exists, so that only the results are printed. */
+class QuietScope
+{
+    public:
+        QuietScope() :
+            m_oldLevel(Log::level())
+        {
+            // Messages are written by a background thread, don't let them interleave with the results
+            Log::flush();
+            Log::setLevel(LogLevel::Warning);
+        }
+
+        QuietScope(const QuietScope &) = delete;
+
+        ~QuietScope() { Log::setLevel(m_oldLevel); }
+
+    private:
+        LogLevel m_oldLevel;
+};
+
+/*!
+ * Runs the given function repeatedly for at least minTime and prints the result
+ * as a JSON object on a single line, so that results can be compared between releases.
+ */
+template<typename F>
+double run(const std::string &name, F &&f, std::chrono::milliseconds minTime = std::chrono::milliseconds(500))
+{
+    using Clock = std::chrono::steady_clock;
+
+    // Warm up
+    f();
+
+    long iterations = 0;
+    auto start = Clock::now();
+    auto end = start;
+
+    do {
+        f();
+        iterations++;
+        end = Clock::now();
+    } while (end - start < minTime);
+
+    double ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count() / static_cast<double>(iterations);
+    std::cout << "{\"benchmark\":\"" << name << "\",\"iterations\":" << iterations << ",\"ns_per_op\":" << ns << "}" << std::endl;
+    return ns;
+}
+
+} // namespace scratchcloud::bench
@@ -0,0 +1,92 @@
+// SPDX-License-Identifier: MIT
+
+#include <algorithm>
+
+#include "benchmark.h"
+#include "cloudlogparser.h"
+
+using namespace scratchcloud;
+
+static std::string generateLog(int count)
+{
+    // Newest record first, like the real API
+    nlohmann::json json = nlohmann::json::array();
+    const long start = 1700000000000;
+
+    for (int i = count - 1; i >= 0; i--) {
+        nlohmann::json record;
+        record["user"] = "user" + std::to_string(i % 16);
+        record["verb"] = "set_var";
+        record["name"] = u8"☁ var" + std::to_string(i % 8);
+
+        if (i % 2 == 0)
+            record["value"] = std::to_string(i * 12345);
+        else
+            record["value"] = i * 12345;
+
+        record["timestamp"] = start + i;
+        json.push_back(record);
+    }
+
+    return json.dump();
+}
+
+// The cloud log parsing code before the streaming parser was introduced
+static void parseDom(const std::string &text, std::vector<CloudLogRecord> &out, long readTime)
+{
+    out.clear();
+    nlohmann::json json = nlohmann::json::parse(text);
+
+    for (auto jsonRecord : json) {
+        CloudLogRecord record(jsonRecord);
+
+        if (record.type() != CloudLogRecord::Type::Invalid && record.timestamp() > readTime)
+            out.push_back(record);
+    }
+
+    std::reverse(out.begin(), out.end());
+}
+
+static void parseSax(const std::string &text, std::vector<CloudLogRecord> &out, long readTime, int limit)
+{
+    out.clear();
+    out.reserve(limit);
+    CloudLogParser parser(out, readTime);
+    parser.parse(text);
+    std::reverse(out.begin(), out.end());
+}
+
+int main()
+{
+    for (int count : { 25, 100, 1000 }) {
+        const std::string text = generateLog(count);
+        const std::string suffix = "/" + std::to_string(count);
+        std::vector<CloudLogRecord> out;
+
+        // Everything is new
+        bench::run("cloudlog/dom/all" + suffix, [&]() {
+            parseDom(text, out, 0);
+            bench::doNotOptimize(out.data());
+        });
+
+        bench::run("cloudlog/sax/all" + suffix, [&]() {
+            parseSax(text, out, 0, count);
+            bench::doNotOptimize(out.data());
+        });
+
+        // Only the newest 5 records are new (typical polling)
+        const long readTime = 1700000000000 + count - 6;
+
+        bench::run("cloudlog/dom/new5" + suffix, [&]() {
+            parseDom(text, out, readTime);
+            bench::doNotOptimize(out.data());
+        });
+
+        bench::run("cloudlog/sax/new5" + suffix, [&]() {
+            parseSax(text, out, readTime, count);
+            bench::doNotOptimize(out.data());
+        });
+    }
+
+    return 0;
+}
@@ -0,0 +1,154 @@
+// SPDX-License-Identifier: MIT
+
+#include <scratchcloudclient/cloudevent.h>
+
+#include "benchmark.h"
+#include "cloudserver.h"
+#include "cloudconnection.h"
+#include "cloudclient_p.h"
+#include "cloudlogrecord.h"
+
+using namespace scratchcloud;
+
+static std::string generateFrame(int count)
+{
+    // A message with one variable per line, like the response to a handshake
+    std::string frame;
+
+    for (int i = 0; i < count; i++)
+        frame += u8"{\"method\":\"set\",\"name\":\"☁ var" + std::to_string(i) + "\",\"value\":\"" + std::to_string(i * 12345) + "\"}\n";
+
+    return frame;
+}
+
+static void benchFrames()
+{
+    for (int count : { 1, 10, 100 }) {
+        const std::string frame = generateFrame(count);
+        const std::string suffix = "/" + std::to_string(count);
+
+        bench::run("frame/split" + suffix, [&]() { bench::doNotOptimize(CloudConnection::splitStr(frame, "\n")); });
+
+        bench::run("frame/parse" + suffix, [&]() {
+            std::vector<std::pair<std::string, std::string>> variables;
+            CloudConnection::parseMessage(frame, variables);
+            bench::doNotOptimize(variables.data());
+        });
+    }
+
+    bench::run("frame/serialize_set", [&]() { bench::doNotOptimize(CloudConnection::setMessage("user", "526557379", "var", "1234567890")); });
+    bench::run("frame/serialize_handshake", [&]() { bench::doNotOptimize(CloudConnection::handshakeMessage("user", "526557379")); });
+}
+
+static void benchCloudLogRecord()
+{
+    nlohmann::json json;
+    json["user"] = "user";
+    json["verb"] = "set_var";
+    json["name"] = u8"☁ var";
+    json["value"] = "1234567890";
+    json["timestamp"] = 1700000000000;
+
+    bench::run("cloudlogrecord/from_json", [&]() {
+        CloudLogRecord record(json);
+        bench::doNotOptimize(record);
+    });
+
+    bench::run("cloudlogrecord/from_fields", [&]() {
+        CloudLogRecord record("user", CloudLogRecord::Type::SetVar, "var", "1234567890", 1700000000000);
+        bench::doNotOptimize(record);
+    });
+}
+
+static void benchReconciliation()
+{
+    for (int connections : { 1, 10, 50 }) {
+        for (int messages : { 10, 100 }) {
+            // Every connection received the same messages (the common case)
+            CloudClientPrivate::ReceivedMessages received;
+
+            for (int i = 0; i < connections; i++) {
+                auto &list = received[reinterpret_cast<CloudConnection *>(static_cast<uintptr_t>(i + 1))];
+
+                for (int j = 0; j < messages; j++)
+                    list.push_back({ "var" + std::to_string(j % 8), std::to_string(j) });
+            }
+
+            bench::run("reconcile/" + std::to_string(connections) + "x" + std::to_string(messages), [&]() {
+                std::vector<std::pair<std::string, std::string>> out;
+                CloudClientPrivate::reconcileMessages(received, out);
+                bench::doNotOptimize(out.data());
+            });
+        }
+    }
+}
+
+static void benchUploadQueue(const CloudServer &server)
+{
+    std::unique_ptr<CloudConnection> connection;
+
+    {
+        bench::QuietScope quiet;
+        connection = std::make_unique<CloudConnection>(0, server.websocketUrl(), "user", "session", "1");
+    }
+
+    for (int count : { 1, 100 }) {
+        bench::run("upload/enqueue_take/" + std::to_string(count), [&]() {
+            for (int i = 0; i < count; i++)
+                connection->uploadVar("var", "1234567890");
+
+            bench::doNotOptimize(connection->takeQueue());
+        });
+    }
+
+    bench::QuietScope quiet;
+    connection.reset();
+}
+
+static void benchNotify(const CloudServer &server)
+{
+    CloudClientOptions options;
+    options.loginUrl = server.loginUrl();
+    options.websocketUrl = server.websocketUrl();
+    options.cloudLogUrl = server.cloudLogUrl();
+    options.connections = 1;
+    std::unique_ptr<CloudClientPrivate> client;
+
+    {
+        bench::QuietScope quiet;
+        client = std::make_unique<CloudClientPrivate>("user", "password", "1", options);
+    }
+
+    long events = 0;
+    client->variableSet.connect([&events](const CloudEvent &) { events++; });
+
+    bench::run("notify/variable_set", [&]() {
+        std::lock_guard<std::mutex> lock(client->listenMutex);
+        client->notifyAboutVar(CloudClient::ListenMode::CloudLog, "user", "var", "1234567890");
+    });
+
+    bench::doNotOptimize(events);
+    bench::QuietScope quiet;
+    client.reset();
+}
+
+int main()
+{
+    benchFrames();
+    benchCloudLogRecord();
+    benchReconciliation();
+
+    // The rest needs a server
+    CloudServerOptions serverOptions;
+    serverOptions.websocketPort = 19180;
+    serverOptions.httpPort = 19181;
+    CloudServer server(serverOptions);
+
+    if (!server.start())
+        return 1;
+
+    benchUploadQueue(server);
+    benchNotify(server);
+
+    return 0;
+}
@@ -0,0 +1,346 @@
+// SPDX-License-Identifier: MIT
+
+#include <scratchcloudclient/cloudevent.h>
+#include <fstream>
+#include <random>
+#include <thread>
+#include <algorithm>
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+#if defined(__unix__)
+#include <unistd.h>
+#endif
+
+#include "benchmark.h"
+#include "cloudserver.h"
+#include "cloudclient_p.h"
+#include "cloudconnection.h"
+#include "clock.h"
+
+#define MAX_SETTLE_TIME 20  // ms (real time)
+#define MIN_SETTLE_TIME 200 // us (real time)
+#define LEAK_THRESHOLD 1.2  // growth after the warmup which is reported as a leak
+#define DRIFT_THRESHOLD 2.0 // growth of p99 after the warmup which is reported as drift
+
+using namespace scratchcloud;
+using RealClock = std::chrono::steady_clock;
+
+/*
+ * Simulates days of traffic against the local stand-in server using a virtual clock:
+ * variables are set by other users (with new variable names appearing over time and
+ * occasional bursts), the client sets variables, and connections are forced to reconnect.
+ * Every simulated hour, memory usage, the sizes of the client's containers and latency
+ * percentiles of that hour are printed as a JSON line. At the end, values which keep
+ * growing after the warmup are reported as leaks or drift.
+ */
+
+struct Config
+{
+        double days = 1;
+        int step = 1000;           // virtual ms per step
+        int connections = 4;
+        int messageRate = 2;       // messages per virtual second
+        int newNamesPerHour = 60;  // new variable names per virtual hour
+        int reconnectsPerHour = 6; // forced reconnects per virtual hour
+        int burstSize = 200;       // messages in a burst (about one per virtual hour)
+};
+
+struct Sample
+{
+        double hours = 0;
+        long rss = 0;       // bytes
+        long heap = 0;      // bytes allocated using malloc (0 if unknown)
+        long variables = 0; // CloudClientPrivate::variables
+        long listenModes = 0;
+        long receivedMessages = 0; // buffered messages in all connections
+        long receivedMessagesKeys = 0;
+        long uploadQueue = 0;
+        long events = 0;
+        long sendP99 = 0;           // virtual us
+        long reconciliationP99 = 0; // virtual us
+        long stepP50 = 0;           // real us
+        long stepP99 = 0;           // real us
+};
+
+static long residentMemory()
+{
+#if defined(__linux__)
+    std::ifstream statm("/proc/self/statm");
+    long pages = 0, resident = 0;
+    statm >> pages >> resident;
+    return resident * sysconf(_SC_PAGESIZE);
+#else
+    return 0;
+#endif
+}
+
+static long heapMemory()
+{
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+    return static_cast<long>(mallinfo2().uordblks);
+#else
+    return 0;
+#endif
+}
+
+static long intervalPercentile(const LatencySnapshot &now, const LatencySnapshot &before, double p)
+{
+    // Percentile of the values recorded between the two snapshots
+    LatencySnapshot delta;
+
+    for (const auto &[value, count] : now.buckets) {
+        auto it = std::find_if(before.buckets.begin(), before.buckets.end(), [value = value](const auto &bucket) { return bucket.first == value; });
+        long n = count - (it == before.buckets.end() ? 0 : it->second);
+
+        if (n > 0) {
+            delta.buckets.push_back({ value, n });
+            delta.count += n;
+        }
+    }
+
+    return delta.percentile(p);
+}
+
+static double percentile(std::vector<double> &values, double p)
+{
+    if (values.empty())
+        return 0;
+
+    size_t index = std::min(values.size() - 1, static_cast<size_t>(p * values.size()));
+    std::nth_element(values.begin(), values.begin() + index, values.end());
+    return values[index];
+}
+
+static void printSample(const Sample &s)
+{
+    std::cout << "{\"hours\":" << s.hours << ",\"rss\":" << s.rss << ",\"heap\":" << s.heap << ",\"variables\":" << s.variables << ",\"listen_modes\":" << s.listenModes
+              << ",\"received_messages\":" << s.receivedMessages << ",\"received_messages_keys\":" << s.receivedMessagesKeys << ",\"upload_queue\":" << s.uploadQueue
+              << ",\"events\":" << s.events << ",\"send_p99_us\":" << s.sendP99 << ",\"reconciliation_p99_us\":" << s.reconciliationP99 << ",\"step_p50_us\":" << s.stepP50
+              << ",\"step_p99_us\":" << s.stepP99 << "}" << std::endl;
+}
+
+static bool checkGrowth(const std::string &name, const std::vector<Sample> &samples, long Sample::*field, double threshold, const std::string &kind)
+{
+    // Compare the end of the run with the end of the warmup (the first quarter)
+    if (samples.size() < 4)
+        return false;
+
+    double base = samples[samples.size() / 4].*field;
+    double last = samples.back().*field;
+
+    if (base > 0 && last > base * threshold) {
+        std::cerr << kind << ": " << name << " grew from " << base << " to " << last << std::endl;
+        return true;
+    }
+
+    return false;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc > 1 && (std::string(argv[1]) == "-h" || std::string(argv[1]) == "--help")) {
+        std::cout << "usage: " << argv[0] << " [days] [step ms] [connections] [messages per second] [new names per hour] [reconnects per hour] [burst size]" << std::endl;
+        return 0;
+    }
+
+    Config config;
+
+    try {
+        if (argc > 1)
+            config.days = std::stod(argv[1]);
+
+        if (argc > 2)
+            config.step = std::max(1, std::stoi(argv[2]));
+
+        if (argc > 3)
+            config.connections = std::max(1, std::stoi(argv[3]));
+
+        if (argc > 4)
+            config.messageRate = std::max(0, std::stoi(argv[4]));
+
+        if (argc > 5)
+            config.newNamesPerHour = std::max(0, std::stoi(argv[5]));
+
+        if (argc > 6)
+            config.reconnectsPerHour = std::max(0, std::stoi(argv[6]));
+
+        if (argc > 7)
+            config.burstSize = std::max(0, std::stoi(argv[7]));
+    } catch (std::exception &e) {
+        std::cerr << "invalid argument: " << e.what() << std::endl;
+        return 1;
+    }
+
+    CloudServerOptions serverOptions;
+    serverOptions.websocketPort = 19480;
+    serverOptions.httpPort = 19481;
+    CloudServer server(serverOptions);
+
+    if (!server.start())
+        return 1;
+
+    // The clock must be installed before the client is created
+    VirtualClock clock;
+    Clock::setClock(&clock);
+
+    CloudClientOptions options;
+    options.loginUrl = server.loginUrl();
+    options.websocketUrl = server.websocketUrl();
+    options.cloudLogUrl = server.cloudLogUrl();
+    options.connections = config.connections;
+    options.minConnections = config.connections;
+    options.maxConnections = config.connections;
+    options.pingInterval = 0; // round-trip times can't be measured in virtual time
+    std::unique_ptr<CloudClientPrivate> client;
+
+    // Connecting takes real time, so keep the virtual time moving meanwhile
+    std::atomic<bool> connecting = true;
+    std::thread connectClock([&]() {
+        while (connecting) {
+            clock.advance(std::chrono::milliseconds(10));
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    });
+
+    {
+        bench::QuietScope quiet;
+        client = std::make_unique<CloudClientPrivate>("soak", "password", "1", options);
+    }
+
+    connecting = false;
+    connectClock.join();
+
+    if (!client->connected) {
+        std::cerr << "the client failed to connect" << std::endl;
+        Clock::setClock(nullptr);
+        return 1;
+    }
+
+    client->listenMutex.lock();
+    client->defaultListenMode = CloudClient::ListenMode::Hybrid;
+    client->listenMutex.unlock();
+
+    std::atomic<long> events = 0;
+    client->variableSet.connect([&events](const CloudEvent &) { events++; });
+
+    const long stepsPerHour = std::max(1L, 3600000L / config.step);
+    const long totalSteps = static_cast<long>(config.days * 24 * stepsPerHour);
+    const double messagesPerStep = config.messageRate * config.step / 1000.0;
+    std::mt19937 random(12345); // the same traffic in every run
+    std::uniform_real_distribution<double> chance(0, 1);
+    long nameCount = 10;
+    double pendingMessages = 0;
+    long sequence = 0;
+    std::vector<double> stepTimes;
+    std::vector<Sample> samples;
+    LatencySnapshot lastSend = client->latency.snapshot(LatencyStage::Send);
+    LatencySnapshot lastReconciliation = client->latency.snapshot(LatencyStage::Reconciliation);
+
+    std::cerr << "simulating " << config.days << " days in " << totalSteps << " steps..." << std::endl;
+    bench::QuietScope quiet; // hides the messages of reconnects
+
+    for (long step = 1; step <= totalSteps; step++) {
+        // Other users set variables (new names appear over time)
+        if (chance(random) < static_cast<double>(config.newNamesPerHour) / stepsPerHour)
+            nameCount++;
+
+        pendingMessages += messagesPerStep;
+
+        if (chance(random) < 1.0 / stepsPerHour)
+            pendingMessages += config.burstSize;
+
+        std::uniform_int_distribution<long> nameDist(0, nameCount - 1);
+
+        for (; pendingMessages >= 1; pendingMessages--) {
+            sequence++;
+            server.setVariable("1", "user" + std::to_string(sequence % 100), "var" + std::to_string(nameDist(random)), std::to_string(sequence));
+        }
+
+        // The client sets variables too
+        if (chance(random) < 0.1)
+            client->uploadVar("own" + std::to_string(nameDist(random) % 10), std::to_string(sequence));
+
+        // Forced reconnects
+        if (chance(random) < static_cast<double>(config.reconnectsPerHour) / stepsPerHour) {
+            std::lock_guard<std::mutex> lock(client->connectionsMutex);
+
+            if (!client->connections.empty()) {
+                auto it = client->connections.begin();
+                std::advance(it, random() % client->connections.size());
+                (*it)->requestReconnect();
+            }
+        }
+
+        // Advance the time and wait until the client threads go back to sleep
+        int sleeping = clock.sleepingThreads();
+        auto realStart = RealClock::now();
+        clock.advance(std::chrono::milliseconds(config.step));
+        std::this_thread::sleep_for(std::chrono::microseconds(MIN_SETTLE_TIME));
+
+        while (clock.sleepingThreads() < sleeping && RealClock::now() - realStart < std::chrono::milliseconds(MAX_SETTLE_TIME))
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+
+        stepTimes.push_back(std::chrono::duration<double, std::micro>(RealClock::now() - realStart).count());
+
+        if (step % stepsPerHour != 0)
+            continue;
+
+        // Hourly sample
+        Sample sample;
+        sample.hours = static_cast<double>(step) / stepsPerHour;
+        sample.rss = residentMemory();
+        sample.heap = heapMemory();
+        sample.events = events;
+
+        client->listenMutex.lock();
+        sample.variables = client->variables.size();
+        sample.listenModes = client->variablesListenMode.size();
+        sample.receivedMessagesKeys = client->receivedMessages.size();
+
+        for (const auto &[conn, list] : client->receivedMessages)
+            sample.receivedMessages += list.size();
+
+        client->listenMutex.unlock();
+
+        client->connectionsMutex.lock();
+
+        for (const auto &conn : client->connections)
+            sample.uploadQueue += conn->queueSize();
+
+        client->connectionsMutex.unlock();
+
+        LatencySnapshot send = client->latency.snapshot(LatencyStage::Send);
+        LatencySnapshot reconciliation = client->latency.snapshot(LatencyStage::Reconciliation);
+        sample.sendP99 = intervalPercentile(send, lastSend, 0.99);
+        sample.reconciliationP99 = intervalPercentile(reconciliation, lastReconciliation, 0.99);
+        lastSend = send;
+        lastReconciliation = reconciliation;
+
+        sample.stepP50 = percentile(stepTimes, 0.5);
+        sample.stepP99 = percentile(stepTimes, 0.99);
+        stepTimes.clear();
+
+        printSample(sample);
+
+        samples.push_back(sample);
+    }
+
+    // Report values which keep growing
+    bool flagged = false;
+    flagged |= checkGrowth("rss", samples, &Sample::rss, LEAK_THRESHOLD, "leak");
+    flagged |= checkGrowth("heap", samples, &Sample::heap, LEAK_THRESHOLD, "leak");
+    flagged |= checkGrowth("variables", samples, &Sample::variables, LEAK_THRESHOLD, "leak");
+    flagged |= checkGrowth("variablesListenMode", samples, &Sample::listenModes, LEAK_THRESHOLD, "leak");
+    flagged |= checkGrowth("receivedMessages", samples, &Sample::receivedMessagesKeys, LEAK_THRESHOLD, "leak");
+    flagged |= checkGrowth("upload queue", samples, &Sample::uploadQueue, LEAK_THRESHOLD, "leak");
+    flagged |= checkGrowth("send p99", samples, &Sample::sendP99, DRIFT_THRESHOLD, "drift");
+    flagged |= checkGrowth("reconciliation p99", samples, &Sample::reconciliationP99, DRIFT_THRESHOLD, "drift");
+    flagged |= checkGrowth("step p99", samples, &Sample::stepP99, DRIFT_THRESHOLD, "drift");
+
+    // Release the client threads before destroying the client
+    Clock::setClock(nullptr);
+    client.reset();
+
+    return flagged ? 2 : 0;
+}
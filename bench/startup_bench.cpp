@@ -0,0 +1,43 @@
+// SPDX-License-Identifier: MIT
+
+#include <scratchcloudclient/cloudclient.h>
+
+#include "benchmark.h"
+#include "cloudserver.h"
+
+using namespace scratchcloud;
+
+int main()
+{
+    CloudServerOptions serverOptions;
+    serverOptions.websocketPort = 19080;
+    serverOptions.httpPort = 19081;
+    serverOptions.latency = 20; // a round trip to the real server takes much longer, but it makes handshakes overlap
+    CloudServer server(serverOptions);
+
+    if (!server.start())
+        return 1;
+
+    // Time until the client is connected, with different numbers of handshakes in flight
+    for (int connections : { 10, 50, 200 }) {
+        for (int pending : { 1, 8, 32 }) {
+            CloudClientOptions options;
+            options.loginUrl = server.loginUrl();
+            options.websocketUrl = server.websocketUrl();
+            options.cloudLogUrl = server.cloudLogUrl();
+            options.connections = connections;
+            options.maxPendingConnections = pending;
+
+            bench::run(
+                "startup/" + std::to_string(connections) + "/pending" + std::to_string(pending),
+                [&options]() {
+                    bench::QuietScope quiet;
+                    CloudClient client("user", "password", "1", options);
+                    bench::doNotOptimize(client.connected());
+                },
+                std::chrono::milliseconds(2000));
+        }
+    }
+
+    return 0;
+}
@@ -3,15 +3,21 @@
 #pragma once
 
 #include <string>
+#include <memory>
+#include <future>
 
 #include "scratchcloudclient_global.h"
 #include "signal.h"
 #include "spimpl.h"
+#include "cloudclientoptions.h"
+#include "latencysnapshot.h"
+#include "metricsample.h"
 
 namespace scratchcloud
 {
 
 class CloudEvent;
+class CloudLogStore;
 class CloudClientPrivate;
 
 /*! \brief The CloudClient class provides a simple API for Scratch cloud data. */
@@ -21,14 +27,18 @@ class SCRATCHCLOUDCLIENT_EXPORT CloudClient
         enum class ListenMode
         {
             CloudLog,  /*!< (Default) Uses Scratch API to read the cloud log. It's slower, but makes it possible to read the variable setter username. */
-            Websockets /*!< Listens to messages using Websockets. Good for multiplayer games because it's real time, but you won't be able to read the setter username. */
+            Websockets, /*!< Listens to messages using Websockets. Good for multiplayer games because it's real time, but you won't be able to read the setter username. */
+            Hybrid      /*!< Listens to messages using Websockets and reads the setter username from the cloud log later (see variableAttributed() and waitForUser()). */
         };
 
         CloudClient(const std::string &username, const std::string &password, const std::string &projectId, int connections = 10);
+        CloudClient(const std::string &username, const std::string &password, const std::string &projectId, const CloudClientOptions &options);
         CloudClient(const CloudClient &) = delete;
 
         bool loginSuccessful() const;
         bool connected() const;
+        int connectionCount() const;
+        std::shared_future<bool> ready() const;
 
         const std::string &getVariable(const std::string &name) const;
         void setVariable(const std::string &name, const std::string &value);
@@ -37,7 +47,17 @@ class SCRATCHCLOUDCLIENT_EXPORT CloudClient
         void setListenMode(ListenMode newMode);
         void setVariableListenMode(const std::string &name, ListenMode mode);
 
+        void setCloudLogStore(std::shared_ptr<CloudLogStore> store);
+
+        std::string waitForUser(const CloudEvent &event, int timeout = 5000);
+
+        LatencySnapshot latency(LatencyStage stage) const;
+        std::vector<MetricSample> metrics() const;
+        std::string metricsText() const;
+
         sigslot::signal<const CloudEvent &> &variableSet();
+        sigslot::signal<const CloudEvent &> &variableAttributed();
+        sigslot::signal<int> &connectionCountChanged();
 
     private:
         spimpl::unique_impl_ptr<CloudClientPrivate> impl;
@@ -0,0 +1,83 @@
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <string>
+
+#include "retrypolicy.h"
+
+namespace scratchcloud
+{
+
+/*! \brief The CloudClientOptions struct holds the configuration of CloudClient. */
+struct CloudClientOptions
+{
+        /*! The number of connections used to upload variables. */
+        int connections = 10;
+
+        /*! The minimum number of connections the pool shrinks to when idle. If it's 0, the pool doesn't shrink below connections. */
+        int minConnections = 0;
+
+        /*! The maximum number of connections the pool grows to when uploads queue up. If it's 0, the pool doesn't grow above connections. */
+        int maxConnections = 0;
+
+        /*! The average number of queued messages per connection above which the pool grows. */
+        int growQueueThreshold = 4;
+
+        /*! The time (in milliseconds) the oldest queued message can wait before the pool grows. */
+        int growDelayThreshold = 1000;
+
+        /*! The time (in milliseconds) without queued messages after which the pool starts to shrink. */
+        int shrinkIdleTime = 60000;
+
+        /*! The maximum number of connections which are being established at the same time. If it's 0, the number of CPU threads is used. */
+        int maxPendingConnections = 0;
+
+        /*!
+         * If true, the constructor returns immediately and logging in and connecting happens in the background.
+         * Use CloudClient::ready() to wait until the client is usable.
+         */
+        bool asyncConnect = false;
+
+        /*!
+         * The number of established connections after which the client is considered ready and starts listening.
+         * If it's 0, all connections must be established.
+         */
+        int readyConnections = 0;
+
+        /*!
+         * The number of event loop threads which drive the upload timers of all connections
+         * and the listen loops of all clients in the process.
+         * If it's 0, each connection and client uses its own threads instead.
+         */
+        int reactorThreads = 0;
+
+        /*! The interval (in milliseconds) in which each connection measures its round-trip time. If it's 0, connections aren't pinged. */
+        int pingInterval = 5000;
+
+        /*! The round-trip time (in milliseconds) above which a connection is considered slow. */
+        int slowConnectionLatency = 2000;
+
+        /*! The time (in milliseconds) after which a connection which stays slow is replaced. */
+        int slowConnectionTime = 30000;
+
+        /*! The policy used to retry logging in, connecting and reading the cloud log. */
+        RetryPolicy retryPolicy;
+
+        /*! The URL of the login endpoint. Use this (and the other URLs) to connect to a different server, e.g. for testing. */
+        std::string loginUrl = "https://scratch.mit.edu/login/";
+
+        /*! The URL of the Websockets server. */
+        std::string websocketUrl = "wss://clouddata.scratch.mit.edu";
+
+        /*! The URL of the cloud log endpoint. */
+        std::string cloudLogUrl = "https://clouddata.scratch.mit.edu/logs";
+
+        /*!
+         * If it's set, all received Websockets messages and cloud log responses are written to this file,
+         * so that they can be replayed later (see the scratchcloudclient_replay tool).
+         */
+        std::string captureFile;
+};
+
+} // namespace scratchcloud
@@ -19,6 +19,8 @@ class CloudEvent
         const std::string &value() const;
 
     private:
+        friend class CloudClient;
+        friend class CloudClientPrivate; // sets the attribution ID
         spimpl::impl_ptr<CloudEventPrivate> impl;
 };
 
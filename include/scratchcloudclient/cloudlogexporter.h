@@ -0,0 +1,40 @@
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <string>
+
+#include "scratchcloudclient_global.h"
+#include "spimpl.h"
+
+namespace scratchcloud
+{
+
+class CloudLogExporterPrivate;
+
+/*! \brief The CloudLogExporter class downloads the full cloud log history of a project. */
+class SCRATCHCLOUDCLIENT_EXPORT CloudLogExporter
+{
+    public:
+        CloudLogExporter(const std::string &projectId);
+        CloudLogExporter(const CloudLogExporter &) = delete;
+
+        const std::string &url() const;
+        void setUrl(const std::string &newUrl);
+
+        int pageSize() const;
+        void setPageSize(int newPageSize);
+
+        int parallelism() const;
+        void setParallelism(int newParallelism);
+
+        int maxRetries() const;
+        void setMaxRetries(int newMaxRetries);
+
+        long exportToFile(const std::string &fileName, long maxRecords = 0);
+
+    private:
+        spimpl::unique_impl_ptr<CloudLogExporterPrivate> impl;
+};
+
+} // namespace scratchcloud
@@ -0,0 +1,49 @@
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "scratchcloudclient_global.h"
+#include "spimpl.h"
+
+namespace scratchcloud
+{
+
+class CloudLogStorePrivate;
+
+/*!
+ * \brief The CloudLogStore class is an append-only on-disk store of cloud log history.
+ *
+ * Records are stored in memory-mapped column files in the given directory and can be
+ * queried by time range without downloading the cloud log again. Use CloudClient::setCloudLogStore()
+ * to feed the store with live cloud log records.
+ */
+class SCRATCHCLOUDCLIENT_EXPORT CloudLogStore
+{
+    public:
+        struct Record
+        {
+                std::string user;
+                std::string name;
+                std::string value;
+                long timestamp = 0;
+        };
+
+        CloudLogStore(const std::string &directory);
+        CloudLogStore(const CloudLogStore &) = delete;
+
+        bool isOpen() const;
+        long size() const;
+
+        void append(const std::vector<Record> &records);
+
+        std::vector<Record> query(long from, long to) const;
+        std::vector<Record> query(const std::string &name, long from, long to) const;
+
+    private:
+        spimpl::unique_impl_ptr<CloudLogStorePrivate> impl;
+};
+
+} // namespace scratchcloud
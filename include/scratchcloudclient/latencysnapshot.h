@@ -0,0 +1,51 @@
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <vector>
+#include <utility>
+
+#include "scratchcloudclient_global.h"
+
+namespace scratchcloud
+{
+
+/*! The stages of the client at which latency is measured (see CloudClient::latency()). */
+enum class LatencyStage
+{
+    Enqueue,        /*!< Queueing a variable in setVariable(). */
+    Send,           /*!< The time a queued variable waits until it's sent. */
+    FrameReceive,   /*!< Processing a message received using Websockets. */
+    Reconciliation, /*!< The time received messages are held until the Websockets connections agree on them. */
+    Dispatch,       /*!< Determining which of the held messages should be emitted. */
+    SlotComplete,   /*!< Running the slots connected to variableSet(). */
+    CloudLogFetch,  /*!< A cloud log request. */
+    CloudLogParse   /*!< Parsing a cloud log response. */
+};
+
+/*!
+ * \brief The LatencySnapshot struct contains the latency histogram of a stage at some point in time.
+ *
+ * All times are in microseconds. The histogram has logarithmic buckets with a relative precision of about 6%.
+ */
+struct SCRATCHCLOUDCLIENT_EXPORT LatencySnapshot
+{
+        /*! The number of recorded values. */
+        long count = 0;
+
+        /*! The smallest recorded value. */
+        long min = 0;
+
+        /*! The largest recorded value. */
+        long max = 0;
+
+        /*! The average of the recorded values. */
+        double mean = 0;
+
+        /*! The non-empty buckets as pairs of the highest value of the bucket and the number of values in it. */
+        std::vector<std::pair<long, long>> buckets;
+
+        long percentile(double p) const;
+};
+
+} // namespace scratchcloud
@@ -0,0 +1,45 @@
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <string>
+#include <functional>
+
+#include "scratchcloudclient_global.h"
+
+namespace scratchcloud
+{
+
+/*! The severity of a log message. */
+enum class LogLevel
+{
+    Debug,
+    Info,
+    Warning,
+    Error,
+    Off /*!< Used with Log::setLevel() to disable logging. */
+};
+
+/*!
+ * \brief The Log class configures the logging of the library.
+ *
+ * Messages are queued in a ring buffer and written by a background thread,
+ * so logging never blocks network or upload threads. If the buffer is full,
+ * messages are dropped. Repeated messages from the same place are rate limited.
+ *
+ * By default, Debug and Info messages are written to stdout and the others to stderr.
+ */
+class SCRATCHCLOUDCLIENT_EXPORT Log
+{
+    public:
+        using Sink = std::function<void(LogLevel level, const std::string &message)>;
+
+        static LogLevel level();
+        static void setLevel(LogLevel level);
+
+        static void setSink(const Sink &sink);
+
+        static void flush();
+};
+
+} // namespace scratchcloud
@@ -0,0 +1,35 @@
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <utility>
+
+namespace scratchcloud
+{
+
+/*! \brief The MetricSample struct holds the current value of a metric (see CloudClient::metrics()). */
+struct MetricSample
+{
+        enum class Type
+        {
+            Counter, /*!< A value which only grows, e.g. the number of sent messages. */
+            Gauge    /*!< A value which can go up and down, e.g. the length of a queue. */
+        };
+
+        /*! The name of the metric, e.g. scratchcloud_messages_sent_total. */
+        std::string name;
+
+        /*! The description of the metric. */
+        std::string help;
+
+        Type type = Type::Counter;
+
+        /*! The labels which distinguish samples of the same metric, e.g. { "connection", "0" }. */
+        std::vector<std::pair<std::string, std::string>> labels;
+
+        double value = 0;
+};
+
+} // namespace scratchcloud
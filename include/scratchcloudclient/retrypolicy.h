@@ -0,0 +1,41 @@
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+namespace scratchcloud
+{
+
+/*!
+ * \brief The RetryPolicy struct configures how failed logins, connections and cloud log requests are retried.
+ *
+ * The delay before the n-th retry is initialDelay * multiplier^(n - 1), limited by maxDelay.
+ * A random part of the delay (given by jitter) is subtracted, so that many connections don't retry at the same time.
+ */
+struct RetryPolicy
+{
+        /*! The maximum number of attempts of a single operation. If it's 0, the operation is retried until it succeeds. */
+        int maxAttempts = 32;
+
+        /*! The delay before the first retry in milliseconds. */
+        int initialDelay = 250;
+
+        /*! The maximum delay between retries in milliseconds. */
+        int maxDelay = 30000;
+
+        /*! The factor by which the delay grows after each retry. */
+        double multiplier = 2;
+
+        /*! The random part of the delay (0 - no jitter, 1 - the delay is between 0 and the full delay). */
+        double jitter = 0.5;
+
+        /*!
+         * The number of consecutive failures (of all connections sharing the policy) after which
+         * all attempts are paused for circuitBreakerCooldown milliseconds. If it's 0, the circuit breaker is disabled.
+         */
+        int circuitBreakerThreshold = 16;
+
+        /*! The time in milliseconds for which attempts are paused when the circuit breaker opens. */
+        int circuitBreakerCooldown = 30000;
+};
+
+} // namespace scratchcloud
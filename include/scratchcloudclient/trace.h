@@ -0,0 +1,32 @@
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <string>
+
+#include "scratchcloudclient_global.h"
+
+namespace scratchcloud
+{
+
+/*!
+ * \brief The Trace class controls the event tracing of the library.
+ *
+ * When the library is built with the SCRATCHCLOUDCLIENT_TRACING option, spans like
+ * connecting, sending variables, the reconciliation of Websockets messages, cloud log
+ * requests and slot calls are recorded into a ring buffer. The buffer can be written
+ * in the Chrome trace format, which can be opened in Perfetto or chrome://tracing.
+ *
+ * Without the option, tracing is compiled out and these functions do nothing.
+ */
+class SCRATCHCLOUDCLIENT_EXPORT Trace
+{
+    public:
+        static bool enabled();
+
+        static bool dump(const std::string &fileName);
+        static void setAutoDump(long threshold, const std::string &fileName);
+        static void clear();
+};
+
+} // namespace scratchcloud
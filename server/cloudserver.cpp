@@ -0,0 +1,457 @@
+// SPDX-License-Identifier: MIT
+
+#include <iostream>
+#include <ixwebsocket/IXWebSocketServer.h>
+#include <ixwebsocket/IXHttpServer.h>
+#include <nlohmann/json.hpp>
+
+#include "cloudserver.h"
+
+#define CLOUD_PREFIX u8"☁ "
+
+using namespace scratchcloud;
+
+CloudServer::CloudServer(const CloudServerOptions &options) :
+    m_options(options),
+    m_random(std::random_device()())
+{
+}
+
+CloudServer::~CloudServer()
+{
+    stop();
+}
+
+/*! Starts listening. Returns false if the servers couldn't be started (e.g. a port is in use). */
+bool CloudServer::start()
+{
+    if (m_running)
+        return true;
+
+    ix::initNetSystem();
+
+    // Websockets
+    m_websocketServer = std::make_unique<ix::WebSocketServer>(m_options.websocketPort, m_options.host);
+
+    m_websocketServer->setOnConnectionCallback([this](std::weak_ptr<ix::WebSocket> webSocket, std::shared_ptr<ix::ConnectionState> connectionState) {
+        std::string id = connectionState->getId();
+        auto ws = webSocket.lock();
+
+        if (!ws)
+            return;
+
+        m_mutex.lock();
+        m_clients[id].webSocket = webSocket;
+        m_mutex.unlock();
+
+        ws->setOnMessageCallback([this, id](const ix::WebSocketMessagePtr &msg) {
+            if (msg->type == ix::WebSocketMessageType::Message)
+                processMessage(id, msg->str);
+            else if (msg->type == ix::WebSocketMessageType::Close) {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_clients.erase(id);
+            }
+        });
+    });
+
+    auto result = m_websocketServer->listen();
+
+    if (!result.first) {
+        std::cerr << "failed to start the Websockets server: " << result.second << std::endl;
+        return false;
+    }
+
+    // HTTP (login and cloud log)
+    m_httpServer = std::make_unique<ix::HttpServer>(m_options.httpPort, m_options.host);
+
+    m_httpServer->setOnConnectionCallback([this](ix::HttpRequestPtr request, std::shared_ptr<ix::ConnectionState>) {
+        ix::WebSocketHttpHeaders headers;
+        headers["Content-Type"] = "application/json";
+
+        if (request->method == "POST" && request->uri.rfind("/login", 0) == 0) {
+            std::string sessionId;
+            int status;
+            std::string body = login(request->body, sessionId, status);
+
+            if (status == 200)
+                headers["Set-Cookie"] = "scratchsessionsid=\"" + sessionId + "\"; Path=/";
+
+            return std::make_shared<ix::HttpResponse>(status, status == 200 ? "OK" : "Forbidden", ix::HttpErrorCode::Ok, headers, body);
+        } else if (request->method == "GET" && request->uri.rfind("/logs", 0) == 0)
+            return std::make_shared<ix::HttpResponse>(200, "OK", ix::HttpErrorCode::Ok, headers, cloudLog(request->uri));
+
+        return std::make_shared<ix::HttpResponse>(404, "Not Found", ix::HttpErrorCode::Ok, headers, "{}");
+    });
+
+    result = m_httpServer->listen();
+
+    if (!result.first) {
+        std::cerr << "failed to start the HTTP server: " << result.second << std::endl;
+        return false;
+    }
+
+    m_stopDelivery = false;
+    m_deliveryThread = std::thread([this]() { deliveryLoop(); });
+    m_websocketServer->start();
+    m_httpServer->start();
+    m_running = true;
+
+    return true;
+}
+
+void CloudServer::stop()
+{
+    if (!m_running)
+        return;
+
+    m_stopDelivery = true;
+    m_deliveryCond.notify_all();
+
+    if (m_deliveryThread.joinable())
+        m_deliveryThread.join();
+
+    m_httpServer->stop();
+    m_websocketServer->stop();
+    m_running = false;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_clients.clear();
+}
+
+/*! Returns the URL to use as CloudClientOptions::loginUrl. */
+std::string CloudServer::loginUrl() const
+{
+    return "http://" + m_options.host + ":" + std::to_string(m_options.httpPort) + "/login/";
+}
+
+/*! Returns the URL to use as CloudClientOptions::websocketUrl. */
+std::string CloudServer::websocketUrl() const
+{
+    return "ws://" + m_options.host + ":" + std::to_string(m_options.websocketPort);
+}
+
+/*! Returns the URL to use as CloudClientOptions::cloudLogUrl. */
+std::string CloudServer::cloudLogUrl() const
+{
+    return "http://" + m_options.host + ":" + std::to_string(m_options.httpPort) + "/logs";
+}
+
+/*! Sets a variable as if it was set by a client of the given user (name is without the cloud prefix). */
+void CloudServer::setVariable(const std::string &projectId, const std::string &user, const std::string &name, const std::string &value)
+{
+    m_received++;
+    broadcast(projectId, "", CLOUD_PREFIX + name, value);
+
+    // The log is written after broadcasting, like on the real server
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Project &p = project(projectId);
+    p.log.push_front({ user, CLOUD_PREFIX + name, value, std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count() });
+
+    while (p.log.size() > static_cast<size_t>(std::max(0, m_options.maxLogRecords)))
+        p.log.pop_back();
+}
+
+/*! Returns the value of the given variable (name is without the cloud prefix). */
+std::string CloudServer::variable(const std::string &projectId, const std::string &name)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return project(projectId).variables[CLOUD_PREFIX + name];
+}
+
+/*! Returns the number of connected clients. */
+int CloudServer::clientCount()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_clients.size();
+}
+
+CloudServer::Stats CloudServer::stats() const
+{
+    Stats stats;
+    stats.received = m_received;
+    stats.delivered = m_delivered;
+    stats.dropped = m_dropped;
+    stats.rateLimited = m_rateLimited;
+
+    return stats;
+}
+
+void CloudServer::processMessage(const std::string &clientId, const std::string &text)
+{
+    // A message can contain multiple lines
+    std::string::size_type start = 0;
+
+    while (start < text.size()) {
+        std::string::size_type end = text.find('\n', start);
+
+        if (end == std::string::npos)
+            end = text.size();
+
+        nlohmann::json json = nlohmann::json::parse(text.begin() + start, text.begin() + end, nullptr, false);
+        start = end + 1;
+
+        if (!json.is_object() || !json.contains("method"))
+            continue;
+
+        const std::string method = json["method"].is_string() ? json["method"].get<std::string>() : "";
+
+        if (method == "handshake") {
+            std::string projectId = json.value("project_id", "");
+            std::weak_ptr<ix::WebSocket> webSocket;
+            std::string variables;
+
+            m_mutex.lock();
+            auto it = m_clients.find(clientId);
+
+            if (it != m_clients.end()) {
+                it->second.projectId = projectId;
+                it->second.user = json.value("user", "");
+                webSocket = it->second.webSocket;
+
+                // Reply with the list of variables
+                for (const auto &[name, value] : project(projectId).variables)
+                    variables += setMessage(name, value);
+            }
+
+            m_mutex.unlock();
+
+            if (!variables.empty())
+                deliver(webSocket, variables);
+        } else if (method == "set") {
+            std::string name = json.value("name", "");
+            std::string value;
+
+            if (json.contains("value"))
+                value = json["value"].is_string() ? json["value"].get<std::string>() : json["value"].dump();
+
+            m_mutex.lock();
+            auto it = m_clients.find(clientId);
+
+            if (it == m_clients.end() || it->second.projectId.empty()) {
+                m_mutex.unlock();
+                continue;
+            }
+
+            Client &client = it->second;
+            std::string projectId = client.projectId;
+            std::string user = client.user;
+
+            if (m_options.rateLimit > 0) {
+                auto now = std::chrono::steady_clock::now();
+
+                if (now - client.rateWindowStart >= std::chrono::seconds(1)) {
+                    client.rateWindowStart = now;
+                    client.rateCount = 0;
+                }
+
+                if (++client.rateCount > m_options.rateLimit) {
+                    m_mutex.unlock();
+                    m_rateLimited++;
+                    continue;
+                }
+            }
+
+            Project &p = project(projectId);
+            p.log.push_front({ user, name, value, std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count() });
+
+            while (p.log.size() > static_cast<size_t>(std::max(0, m_options.maxLogRecords)))
+                p.log.pop_back();
+
+            m_mutex.unlock();
+
+            m_received++;
+            broadcast(projectId, clientId, name, value);
+        }
+    }
+}
+
+void CloudServer::broadcast(const std::string &projectId, const std::string &senderId, const std::string &name, const std::string &value)
+{
+    std::vector<std::weak_ptr<ix::WebSocket>> targets;
+
+    m_mutex.lock();
+    project(projectId).variables[name] = value;
+
+    // The sender doesn't receive its own message
+    for (const auto &[id, client] : m_clients) {
+        if (id != senderId && client.projectId == projectId)
+            targets.push_back(client.webSocket);
+    }
+
+    m_mutex.unlock();
+
+    const std::string message = setMessage(name, value);
+
+    for (const auto &webSocket : targets)
+        deliver(webSocket, message);
+}
+
+void CloudServer::deliver(const std::weak_ptr<ix::WebSocket> &webSocket, const std::string &message)
+{
+    std::unique_lock<std::mutex> lock(m_deliveryMutex);
+
+    if (m_options.dropRate > 0 && std::uniform_real_distribution<double>(0, 1)(m_random) < m_options.dropRate) {
+        m_dropped++;
+        return;
+    }
+
+    int latency = m_options.latency;
+
+    if (m_options.latencyJitter > 0)
+        latency += std::uniform_int_distribution<int>(0, m_options.latencyJitter)(m_random);
+
+    if (latency <= 0) {
+        lock.unlock();
+
+        if (auto ws = webSocket.lock()) {
+            ws->send(message);
+            m_delivered++;
+        }
+
+        return;
+    }
+
+    m_deliveries.push({ std::chrono::steady_clock::now() + std::chrono::milliseconds(latency), webSocket, message });
+    lock.unlock();
+    m_deliveryCond.notify_one();
+}
+
+void CloudServer::deliveryLoop()
+{
+    std::unique_lock<std::mutex> lock(m_deliveryMutex);
+
+    while (!m_stopDelivery) {
+        if (m_deliveries.empty()) {
+            m_deliveryCond.wait(lock, [this]() { return m_stopDelivery || !m_deliveries.empty(); });
+            continue;
+        }
+
+        auto time = m_deliveries.top().time;
+
+        if (std::chrono::steady_clock::now() < time) {
+            m_deliveryCond.wait_until(lock, time);
+            continue;
+        }
+
+        Delivery delivery = m_deliveries.top();
+        m_deliveries.pop();
+        lock.unlock();
+
+        if (auto ws = delivery.webSocket.lock()) {
+            ws->send(delivery.message);
+            m_delivered++;
+        }
+
+        lock.lock();
+    }
+}
+
+CloudServer::Project &CloudServer::project(const std::string &projectId)
+{
+    // Must be called with m_mutex locked
+    auto it = m_projects.find(projectId);
+
+    if (it != m_projects.end())
+        return it->second;
+
+    Project &p = m_projects[projectId];
+
+    for (int i = 0; i < m_options.variables; i++)
+        p.variables[CLOUD_PREFIX "var" + std::to_string(i)] = "0";
+
+    return p;
+}
+
+std::string CloudServer::login(const std::string &body, std::string &sessionId, int &status)
+{
+    nlohmann::json json = nlohmann::json::parse(body, nullptr, false);
+    std::string username;
+    std::string password;
+
+    if (json.is_object()) {
+        username = json.value("username", "");
+        password = json.value("password", "");
+    }
+
+    if (username.empty() || (!m_options.password.empty() && password != m_options.password)) {
+        status = 403;
+        return "[{\"success\":0,\"msg\":\"Incorrect username or password.\"}]";
+    }
+
+    status = 200;
+    sessionId = randomToken();
+
+    nlohmann::json response = nlohmann::json::array();
+    response.push_back({ { "username", username }, { "token", randomToken() }, { "success", 1 } });
+    return response.dump();
+}
+
+std::string CloudServer::cloudLog(const std::string &uri)
+{
+    // Parse the query (projectid, limit, offset)
+    std::string projectId;
+    int limit = 100;
+    int offset = 0;
+    std::string::size_type start = uri.find('?');
+
+    while (start != std::string::npos) {
+        start++;
+        std::string::size_type end = uri.find('&', start);
+        std::string param = uri.substr(start, end == std::string::npos ? std::string::npos : end - start);
+        std::string::size_type eq = param.find('=');
+
+        if (eq != std::string::npos) {
+            std::string key = param.substr(0, eq);
+            std::string value = param.substr(eq + 1);
+
+            try {
+                if (key == "projectid")
+                    projectId = value;
+                else if (key == "limit")
+                    limit = std::stoi(value);
+                else if (key == "offset")
+                    offset = std::stoi(value);
+            } catch (std::exception &) {
+            }
+        }
+
+        start = end;
+    }
+
+    nlohmann::json json = nlohmann::json::array();
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const auto &log = project(projectId).log;
+
+    const size_t first = std::max(0, offset);
+    const size_t last = std::min(log.size(), static_cast<size_t>(std::max(0, offset + limit)));
+
+    for (size_t i = first; i < last; i++) {
+        const LogRecord &record = log[i];
+        json.push_back({ { "user", record.user }, { "verb", "set_var" }, { "name", record.name }, { "value", record.value }, { "timestamp", record.timestamp } });
+    }
+
+    return json.dump();
+}
+
+std::string CloudServer::setMessage(const std::string &name, const std::string &value)
+{
+    nlohmann::json json;
+    json["method"] = "set";
+    json["name"] = name;
+    json["value"] = value;
+
+    return json.dump() + "\n";
+}
+
+std::string CloudServer::randomToken()
+{
+    static const char chars[] = "0123456789abcdefghijklmnopqrstuvwxyz";
+    thread_local std::mt19937 random(std::random_device{}());
+    std::uniform_int_distribution<int> dist(0, sizeof(chars) - 2);
+    std::string token(32, ' ');
+
+    for (char &c : token)
+        c = chars[dist(random)];
+
+    return token;
+}
@@ -0,0 +1,163 @@
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <string>
+#include <memory>
+#include <unordered_map>
+#include <map>
+#include <deque>
+#include <queue>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <random>
+
+namespace ix
+{
+class WebSocket;
+class WebSocketServer;
+class HttpServer;
+class ConnectionState;
+} // namespace ix
+
+namespace scratchcloud
+{
+
+/*! \brief The CloudServerOptions struct holds the configuration of CloudServer. */
+struct CloudServerOptions
+{
+        /*! The address the server listens on. */
+        std::string host = "127.0.0.1";
+
+        /*! The port of the Websockets server. */
+        int websocketPort = 9080;
+
+        /*! The port of the HTTP server (login and cloud log). */
+        int httpPort = 9081;
+
+        /*! The password required to log in. If it's empty, any password is accepted. */
+        std::string password;
+
+        /*! The time (in milliseconds) after which a message is delivered to a client. */
+        int latency = 0;
+
+        /*! The maximum random time (in milliseconds) added to the latency. */
+        int latencyJitter = 0;
+
+        /*! The probability (0 to 1) that a message to a client is dropped. */
+        double dropRate = 0;
+
+        /*! The maximum number of variables a connection can set per second (the rest is ignored). If it's 0, there's no limit. */
+        int rateLimit = 0;
+
+        /*! The number of variables new projects have. Clients can only connect to projects with at least one variable. */
+        int variables = 10;
+
+        /*! The maximum number of records in the cloud log of a project. */
+        int maxLogRecords = 10000;
+};
+
+/*!
+ * \brief The CloudServer class is a local stand-in for the Scratch cloud server.
+ *
+ * It speaks the handshake/set protocol over Websockets and serves the login
+ * and cloud log endpoints over HTTP, so that the client can be tested and
+ * benchmarked offline. Latency, message drops and rate limits can be simulated.
+ */
+class CloudServer
+{
+    public:
+        struct Stats
+        {
+                long received = 0;    // set messages received from clients (or injected using setVariable())
+                long delivered = 0;   // messages sent to clients
+                long dropped = 0;     // messages dropped because of dropRate
+                long rateLimited = 0; // set messages ignored because of rateLimit
+        };
+
+        CloudServer(const CloudServerOptions &options = CloudServerOptions());
+        CloudServer(const CloudServer &) = delete;
+        ~CloudServer();
+
+        bool start();
+        void stop();
+
+        std::string loginUrl() const;
+        std::string websocketUrl() const;
+        std::string cloudLogUrl() const;
+
+        void setVariable(const std::string &projectId, const std::string &user, const std::string &name, const std::string &value);
+        std::string variable(const std::string &projectId, const std::string &name);
+
+        int clientCount();
+        Stats stats() const;
+
+    private:
+        using TimePoint = std::chrono::steady_clock::time_point;
+
+        struct Client
+        {
+                std::weak_ptr<ix::WebSocket> webSocket;
+                std::string projectId;
+                std::string user;
+                TimePoint rateWindowStart;
+                int rateCount = 0;
+        };
+
+        struct LogRecord
+        {
+                std::string user;
+                std::string name;
+                std::string value;
+                long long timestamp;
+        };
+
+        struct Project
+        {
+                std::map<std::string, std::string> variables;
+                std::deque<LogRecord> log; // the newest record is first
+        };
+
+        struct Delivery
+        {
+                TimePoint time;
+                std::weak_ptr<ix::WebSocket> webSocket;
+                std::string message;
+
+                bool operator>(const Delivery &other) const { return time > other.time; }
+        };
+
+        void processMessage(const std::string &clientId, const std::string &text);
+        void broadcast(const std::string &projectId, const std::string &senderId, const std::string &name, const std::string &value);
+        void deliver(const std::weak_ptr<ix::WebSocket> &webSocket, const std::string &message);
+        void deliveryLoop();
+        Project &project(const std::string &projectId);
+        std::string login(const std::string &body, std::string &sessionId, int &status);
+        std::string cloudLog(const std::string &uri);
+        static std::string setMessage(const std::string &name, const std::string &value);
+        std::string randomToken();
+
+        CloudServerOptions m_options;
+        std::unique_ptr<ix::WebSocketServer> m_websocketServer;
+        std::unique_ptr<ix::HttpServer> m_httpServer;
+        bool m_running = false;
+        std::unordered_map<std::string, Client> m_clients;
+        std::unordered_map<std::string, Project> m_projects;
+        std::mutex m_mutex;
+        std::mt19937 m_random; // used with m_deliveryMutex locked
+        std::priority_queue<Delivery, std::vector<Delivery>, std::greater<Delivery>> m_deliveries;
+        std::thread m_deliveryThread;
+        std::atomic<bool> m_stopDelivery = false;
+        std::mutex m_deliveryMutex;
+        std::condition_variable m_deliveryCond;
+        std::atomic<long> m_received = 0;
+        std::atomic<long> m_delivered = 0;
+        std::atomic<long> m_dropped = 0;
+        std::atomic<long> m_rateLimited = 0;
+};
+
+} // namespace scratchcloud
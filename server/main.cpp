@@ -0,0 +1,52 @@
+// SPDX-License-Identifier: MIT
+
+#include <iostream>
+
+#include "cloudserver.h"
+
+using namespace scratchcloud;
+
+int main(int argc, char **argv)
+{
+    if (argc > 1 && (std::string(argv[1]) == "-h" || std::string(argv[1]) == "--help")) {
+        std::cout << "usage: " << argv[0] << " [Websockets port] [HTTP port] [latency ms] [drop rate] [rate limit]" << std::endl;
+        return 0;
+    }
+
+    CloudServerOptions options;
+
+    try {
+        if (argc > 1)
+            options.websocketPort = std::stoi(argv[1]);
+
+        if (argc > 2)
+            options.httpPort = std::stoi(argv[2]);
+
+        if (argc > 3)
+            options.latency = std::stoi(argv[3]);
+
+        if (argc > 4)
+            options.dropRate = std::stod(argv[4]);
+
+        if (argc > 5)
+            options.rateLimit = std::stoi(argv[5]);
+    } catch (std::exception &e) {
+        std::cerr << "invalid argument: " << e.what() << std::endl;
+        return 1;
+    }
+
+    CloudServer server(options);
+
+    if (!server.start())
+        return 1;
+
+    std::cout << "login:     " << server.loginUrl() << std::endl;
+    std::cout << "websocket: " << server.websocketUrl() << std::endl;
+    std::cout << "cloud log: " << server.cloudLogUrl() << std::endl;
+    std::cout << "press Enter to stop" << std::endl;
+    std::cin.get();
+
+    CloudServer::Stats stats = server.stats();
+    std::cout << "received: " << stats.received << ", delivered: " << stats.delivered << ", dropped: " << stats.dropped << ", rate limited: " << stats.rateLimited << std::endl;
+    return 0;
+}
@@ -0,0 +1,91 @@
+// SPDX-License-Identifier: MIT
+
+#include <algorithm>
+
+#include "attributionmatcher.h"
+#include "clock.h"
+
+#define PENDING_TIMEOUT 30000
+#define RESOLVED_TIMEOUT 60000
+#define MAX_CLOCK_SKEW 10000
+
+using namespace scratchcloud;
+
+static long currentTimestamp()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+/*! Registers an event received using Websockets and returns its ID. */
+unsigned long AttributionMatcher::add(const std::string &name, const std::string &value)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    PendingEvent event;
+    event.id = ++m_lastId;
+    event.name = name;
+    event.value = value;
+    event.receiveTime = currentTimestamp();
+    event.time = Clock::now();
+    m_pending.push_back(std::move(event));
+
+    return m_lastId;
+}
+
+/*! Matches a cloud log record with the oldest pending event and returns the ID of the event (or 0 if there isn't any). */
+unsigned long AttributionMatcher::match(const std::string &name, const std::string &value, long timestamp, const std::string &user)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    for (auto it = m_pending.begin(); it != m_pending.end(); it++) {
+        // The variable must have been set before the event was received
+        if (it->name == name && it->value == value && timestamp <= it->receiveTime + MAX_CLOCK_SKEW) {
+            unsigned long id = it->id;
+            m_resolved[id] = { user, Clock::now() };
+            m_pending.erase(it);
+            m_cond.notify_all();
+            return id;
+        }
+    }
+
+    return 0;
+}
+
+/*! Waits until the setter of the given event is known and returns it. Returns an empty string if it couldn't be found in time. */
+std::string AttributionMatcher::waitForUser(unsigned long id, std::chrono::milliseconds timeout)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    auto isPending = [this, id]() { return std::find_if(m_pending.begin(), m_pending.end(), [id](const PendingEvent &event) { return event.id == id; }) != m_pending.end(); };
+
+    // Stop waiting if the event is resolved or has expired
+    Clock::waitFor(m_cond, lock, timeout, [this, id, &isPending]() { return m_resolved.find(id) != m_resolved.cend() || !isPending(); });
+    auto it = m_resolved.find(id);
+
+    if (it == m_resolved.cend())
+        return "";
+
+    return it->second.user;
+}
+
+/*! Removes events which are too old to be matched or waited for. */
+void AttributionMatcher::expire()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto now = Clock::now();
+    bool changed = false;
+
+    while (!m_pending.empty() && std::chrono::duration_cast<std::chrono::milliseconds>(now - m_pending.front().time).count() >= PENDING_TIMEOUT) {
+        m_pending.pop_front();
+        changed = true;
+    }
+
+    for (auto it = m_resolved.begin(); it != m_resolved.end();) {
+        if (std::chrono::duration_cast<std::chrono::milliseconds>(now - it->second.time).count() >= RESOLVED_TIMEOUT)
+            it = m_resolved.erase(it);
+        else
+            it++;
+    }
+
+    if (changed)
+        m_cond.notify_all();
+}
@@ -0,0 +1,54 @@
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <string>
+#include <deque>
+#include <unordered_map>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+namespace scratchcloud
+{
+
+/*!
+ * \brief The AttributionMatcher class matches Websockets events with cloud log records.
+ *
+ * Events received in Hybrid mode are registered as pending. Cloud log records are
+ * then matched with the oldest pending event of the same variable and value.
+ */
+class AttributionMatcher
+{
+    public:
+        using TimePoint = std::chrono::steady_clock::time_point;
+
+        unsigned long add(const std::string &name, const std::string &value);
+        unsigned long match(const std::string &name, const std::string &value, long timestamp, const std::string &user);
+        std::string waitForUser(unsigned long id, std::chrono::milliseconds timeout);
+        void expire();
+
+    private:
+        struct PendingEvent
+        {
+                unsigned long id = 0;
+                std::string name;
+                std::string value;
+                long receiveTime = 0; // ms since epoch, comparable with cloud log timestamps
+                TimePoint time;
+        };
+
+        struct ResolvedEvent
+        {
+                std::string user;
+                TimePoint time;
+        };
+
+        std::deque<PendingEvent> m_pending;
+        std::unordered_map<unsigned long, ResolvedEvent> m_resolved;
+        unsigned long m_lastId = 0;
+        std::mutex m_mutex;
+        std::condition_variable m_cond;
+};
+
+} // namespace scratchcloud
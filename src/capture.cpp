@@ -0,0 +1,127 @@
+// SPDX-License-Identifier: MIT
+
+#include <algorithm>
+
+#include "capture.h"
+#include "clock.h"
+#include "logger.h"
+
+#define CAPTURE_MAGIC "SCCAP"
+#define CAPTURE_VERSION 1
+
+using namespace scratchcloud;
+
+CaptureWriter::CaptureWriter(const std::string &fileName) :
+    m_file(fileName, std::ios::binary | std::ios::trunc),
+    m_start(Clock::now())
+{
+    if (!m_file.is_open()) {
+        SCRATCHCLOUD_LOG_ERROR("could not open capture file " << fileName);
+        return;
+    }
+
+    m_file.write(CAPTURE_MAGIC, sizeof(CAPTURE_MAGIC) - 1);
+    m_file.put(CAPTURE_VERSION);
+}
+
+bool CaptureWriter::isOpen() const
+{
+    return m_file.is_open();
+}
+
+/*! Appends a record with the current time. This can be called from any thread. */
+void CaptureWriter::write(CaptureRecord::Type type, int source, const std::string &data)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (!m_file.is_open())
+        return;
+
+    // Records are written in order, so the time difference can't be negative
+    long long time = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - m_start).count();
+    time = std::max(time, m_lastTime);
+
+    m_file.put(static_cast<char>(type));
+    writeNumber(time - m_lastTime);
+    writeNumber(source + 1);
+    writeNumber(data.size());
+    m_file.write(data.data(), data.size());
+    m_lastTime = time;
+}
+
+void CaptureWriter::writeNumber(unsigned long long value)
+{
+    // LEB128: 7 bits per byte, the highest bit is set if more bytes follow
+    while (value >= 0x80) {
+        m_file.put(static_cast<char>((value & 0x7F) | 0x80));
+        value >>= 7;
+    }
+
+    m_file.put(static_cast<char>(value));
+}
+
+CaptureReader::CaptureReader(const std::string &fileName) :
+    m_file(fileName, std::ios::binary)
+{
+    if (!m_file.is_open()) {
+        SCRATCHCLOUD_LOG_ERROR("could not open capture file " << fileName);
+        return;
+    }
+
+    char header[sizeof(CAPTURE_MAGIC)];
+    m_file.read(header, sizeof(header));
+
+    if (!m_file || std::string(header, sizeof(CAPTURE_MAGIC) - 1) != CAPTURE_MAGIC || header[sizeof(CAPTURE_MAGIC) - 1] != CAPTURE_VERSION) {
+        SCRATCHCLOUD_LOG_ERROR(fileName << " is not a capture file");
+        return;
+    }
+
+    m_valid = true;
+}
+
+/*! Returns true if the file has been opened and has a valid header. */
+bool CaptureReader::isOpen() const
+{
+    return m_valid;
+}
+
+/*! Reads the next record. Returns false at the end of the file or if the record is truncated. */
+bool CaptureReader::next(CaptureRecord &record)
+{
+    if (!m_valid)
+        return false;
+
+    int type = m_file.get();
+    unsigned long long delta, source, size;
+
+    if (type == std::ifstream::traits_type::eof() || !readNumber(delta) || !readNumber(source) || !readNumber(size))
+        return false;
+
+    m_time += delta;
+    record.type = static_cast<CaptureRecord::Type>(type);
+    record.time = m_time;
+    record.source = static_cast<int>(source) - 1;
+    record.data.resize(size);
+    m_file.read(record.data.data(), size);
+
+    return static_cast<unsigned long long>(m_file.gcount()) == size;
+}
+
+bool CaptureReader::readNumber(unsigned long long &value)
+{
+    value = 0;
+
+    for (int shift = 0; shift < 64; shift += 7) {
+        int byte = m_file.get();
+
+        if (byte == std::ifstream::traits_type::eof())
+            return false;
+
+        value |= static_cast<unsigned long long>(byte & 0x7F) << shift;
+
+        if (!(byte & 0x80))
+            return true;
+    }
+
+    return false;
+}
@@ -0,0 +1,71 @@
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <string>
+#include <fstream>
+#include <mutex>
+#include <chrono>
+
+namespace scratchcloud
+{
+
+/*! \brief The CaptureRecord struct is a single message in a capture file. */
+struct CaptureRecord
+{
+        enum class Type : unsigned char
+        {
+            Frame = 1,   // a Websockets message
+            CloudLog = 2 // a cloud log response
+        };
+
+        Type type = Type::Frame;
+        long long time = 0; // microseconds since the start of the capture
+        int source = -1;    // the ID of the connection (-1 for cloud log responses)
+        std::string data;
+};
+
+/*!
+ * \brief The CaptureWriter class writes incoming traffic to a capture file.
+ *
+ * The file starts with a header, followed by the records. Each record consists of
+ * its type, the time since the previous record, the source and the size of the data
+ * (as variable-length integers) and the data itself.
+ */
+class CaptureWriter
+{
+    public:
+        CaptureWriter(const std::string &fileName);
+        CaptureWriter(const CaptureWriter &) = delete;
+
+        bool isOpen() const;
+        void write(CaptureRecord::Type type, int source, const std::string &data);
+
+    private:
+        void writeNumber(unsigned long long value);
+
+        std::ofstream m_file;
+        std::chrono::steady_clock::time_point m_start;
+        long long m_lastTime = 0;
+        std::mutex m_mutex;
+};
+
+/*! \brief The CaptureReader class reads the records of a capture file written by CaptureWriter. */
+class CaptureReader
+{
+    public:
+        CaptureReader(const std::string &fileName);
+        CaptureReader(const CaptureReader &) = delete;
+
+        bool isOpen() const;
+        bool next(CaptureRecord &record);
+
+    private:
+        bool readNumber(unsigned long long &value);
+
+        std::ifstream m_file;
+        bool m_valid = false;
+        long long m_time = 0;
+};
+
+} // namespace scratchcloud
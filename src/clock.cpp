@@ -0,0 +1,111 @@
+// SPDX-License-Identifier: MIT
+
+#include <atomic>
+#include <thread>
+#include <algorithm>
+
+#include "clock.h"
+
+using namespace scratchcloud;
+
+static std::atomic<Clock *> currentClock = nullptr;
+
+/*! Returns the current time of the installed clock. */
+Clock::TimePoint Clock::now()
+{
+    Clock *clock = currentClock.load(std::memory_order_acquire);
+    return clock ? clock->time() : std::chrono::steady_clock::now();
+}
+
+void Clock::sleepFor(Duration duration)
+{
+    sleepUntil(now() + duration);
+}
+
+void Clock::sleepUntil(TimePoint time)
+{
+    Clock *clock = currentClock.load(std::memory_order_acquire);
+
+    if (clock)
+        clock->sleep(time);
+    else
+        std::this_thread::sleep_until(time);
+}
+
+/*! Waits for the condition variable until it's notified or the given time has passed. Spurious wakeups are possible. */
+void Clock::waitUntil(std::condition_variable &cond, std::unique_lock<std::mutex> &lock, TimePoint time)
+{
+    if (!clock())
+        cond.wait_until(lock, time);
+    else if (now() < time)
+        cond.wait_for(lock, std::chrono::milliseconds(VIRTUAL_WAIT_SLICE));
+}
+
+/*! Returns the installed clock, or nullptr if the system clock is used. */
+Clock *Clock::clock()
+{
+    return currentClock.load(std::memory_order_acquire);
+}
+
+/*!
+ * Installs the given clock for the whole process. Use nullptr to go back to the system clock.
+ * \note The clock must be installed before any clients are created and must outlive them.
+ */
+void Clock::setClock(Clock *clock)
+{
+    Clock *oldClock = currentClock.exchange(clock);
+
+    if (oldClock && oldClock != clock)
+        oldClock->release();
+}
+
+VirtualClock::VirtualClock(TimePoint start) :
+    m_time(start)
+{
+}
+
+/*! Moves the time forward and wakes up the threads which sleep until then. */
+void VirtualClock::advance(Duration duration)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_time += std::max(Duration::zero(), duration);
+    lock.unlock();
+    m_cond.notify_all();
+}
+
+void VirtualClock::advanceTo(TimePoint time)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_time = std::max(m_time, time);
+    lock.unlock();
+    m_cond.notify_all();
+}
+
+/*! Returns the number of threads sleeping in Clock::sleepFor() or Clock::sleepUntil(). */
+int VirtualClock::sleepingThreads() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_sleepingThreads;
+}
+
+Clock::TimePoint VirtualClock::time() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_time;
+}
+
+void VirtualClock::sleep(TimePoint time)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_sleepingThreads++;
+    m_cond.wait(lock, [this, time]() { return m_time >= time || m_released; });
+    m_sleepingThreads--;
+}
+
+void VirtualClock::release()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_released = true;
+    lock.unlock();
+    m_cond.notify_all();
+}
@@ -0,0 +1,108 @@
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+
+#define VIRTUAL_WAIT_SLICE 1
+
+namespace scratchcloud
+{
+
+/*!
+ * \brief The Clock class is the time source of the library.
+ *
+ * All timeouts, intervals, backoff and latency measurements use the static functions
+ * of this class instead of std::chrono::steady_clock and std::this_thread directly.
+ * By default they use the system clock, but a different clock (e.g. VirtualClock)
+ * can be installed using setClock(), so that long-running schedules can be tested quickly.
+ */
+class Clock
+{
+    public:
+        using TimePoint = std::chrono::steady_clock::time_point;
+        using Duration = std::chrono::steady_clock::duration;
+
+        virtual ~Clock() { }
+
+        static TimePoint now();
+        static void sleepFor(Duration duration);
+        static void sleepUntil(TimePoint time);
+
+        static void waitUntil(std::condition_variable &cond, std::unique_lock<std::mutex> &lock, TimePoint time);
+
+        template<class Predicate>
+        static bool waitUntil(std::condition_variable &cond, std::unique_lock<std::mutex> &lock, TimePoint time, Predicate pred);
+
+        template<class Predicate>
+        static bool waitFor(std::condition_variable &cond, std::unique_lock<std::mutex> &lock, Duration duration, Predicate pred)
+        {
+            return waitUntil(cond, lock, now() + duration, pred);
+        }
+
+        static Clock *clock();
+        static void setClock(Clock *clock);
+
+    protected:
+        virtual TimePoint time() const = 0;
+        virtual void sleep(TimePoint time) = 0;
+        virtual void release() { } // called when the clock is uninstalled
+};
+
+/*!
+ * \brief The VirtualClock class is a clock which only moves forward when advance() is called.
+ *
+ * Threads sleeping in Clock::sleepFor() wake up when the virtual time reaches their deadline
+ * or when the clock is uninstalled (so that clients can be destroyed without advancing the time).
+ * Condition variable waits are woken up at least every millisecond of real time to check
+ * the virtual time, so notifications work as usual.
+ */
+class VirtualClock : public Clock
+{
+    public:
+        VirtualClock(TimePoint start = std::chrono::steady_clock::now());
+        VirtualClock(const VirtualClock &) = delete;
+
+        void advance(Duration duration);
+        void advanceTo(TimePoint time);
+        int sleepingThreads() const;
+
+    protected:
+        TimePoint time() const override;
+        void sleep(TimePoint time) override;
+        void release() override;
+
+    private:
+        TimePoint m_time;
+        bool m_released = false;
+        int m_sleepingThreads = 0;
+        mutable std::mutex m_mutex;
+        std::condition_variable m_cond;
+};
+
+/*!
+ * Waits for the condition variable until the predicate returns true or the given time has passed.
+ * Returns the result of the predicate. If the clock is changed during the wait, it returns immediately.
+ */
+template<class Predicate>
+bool Clock::waitUntil(std::condition_variable &cond, std::unique_lock<std::mutex> &lock, TimePoint time, Predicate pred)
+{
+    Clock *installed = clock();
+
+    if (!installed)
+        return cond.wait_until(lock, time, pred);
+
+    while (!pred()) {
+        // The deadline is in the time of the installed clock, so stop waiting if it's uninstalled
+        if (clock() != installed || now() >= time)
+            return pred();
+
+        cond.wait_for(lock, std::chrono::milliseconds(VIRTUAL_WAIT_SLICE));
+    }
+
+    return true;
+}
+
+} // namespace scratchcloud
@@ -1,16 +1,31 @@
 // SPDX-License-Identifier: MIT
 
-#include <iostream>
-
 #include "cloudclient.h"
+#include "cloudevent.h"
 #include "cloudclient_p.h"
 #include "cloudconnection.h"
+#include "cloudevent_p.h"
+#include "clock.h"
+#include "logger.h"
 
 using namespace scratchcloud;
 
+static CloudClientOptions defaultOptions(int connections)
+{
+    CloudClientOptions options;
+    options.connections = connections;
+    return options;
+}
+
 /*! Constructs CloudClient and connects to a project using Scratch username, password and project ID. */
 CloudClient::CloudClient(const std::string &username, const std::string &password, const std::string &projectId, int connections) :
-    impl(spimpl::make_unique_impl<CloudClientPrivate>(username, password, projectId, connections))
+    CloudClient(username, password, projectId, defaultOptions(connections))
+{
+}
+
+/*! Constructs CloudClient and connects to a project using Scratch username, password, project ID and the given options. */
+CloudClient::CloudClient(const std::string &username, const std::string &password, const std::string &projectId, const CloudClientOptions &options) :
+    impl(spimpl::make_unique_impl<CloudClientPrivate>(username, password, projectId, options))
 {
 }
 
@@ -20,19 +35,35 @@ bool CloudClient::loginSuccessful() const
     return impl->loginSuccessful;
 }
 
-/*! Returns true if the client is connected to the project. */
+/*! Returns true if the client is connected to the project (all connections are established). */
 bool CloudClient::connected() const
 {
     return impl->connected;
 }
 
+/*! Returns the number of established connections. */
+int CloudClient::connectionCount() const
+{
+    return impl->readyConnectionCount;
+}
+
+/*!
+ * Returns a future which becomes true when the client is usable (see CloudClientOptions::readyConnections),
+ * or false if logging in or connecting failed.
+ * \note This is useful with CloudClientOptions::asyncConnect, otherwise the future is already set when the constructor returns.
+ */
+std::shared_future<bool> CloudClient::ready() const
+{
+    return impl->readyFuture;
+}
+
 /*! Returns the value of the given cloud variable. */
 const std::string &CloudClient::getVariable(const std::string &name) const
 {
     auto it = impl->variables.find(name);
 
     if (it == impl->variables.cend()) {
-        std::cerr << "variable " << name << " not found in project" << std::endl;
+        SCRATCHCLOUD_LOG_WARNING("variable " << name << " not found in project");
         static const std::string empty;
         return empty;
     }
@@ -46,12 +77,15 @@ void CloudClient::setVariable(const std::string &name, const std::string &value)
     auto it = impl->variables.find(name);
 
     if (it == impl->variables.cend()) {
-        std::cout << "variable " << name << " not found in project, but setting anyway" << std::endl;
+        SCRATCHCLOUD_LOG_INFO("variable " << name << " not found in project, but setting anyway");
         impl->variablesListenMode[name] = impl->defaultListenMode;
     }
 
     impl->variables[name] = value;
+
+    auto start = Clock::now();
     impl->uploadVar(name, value);
+    impl->latency.record(LatencyStage::Enqueue, start);
 }
 
 /*! Sleeps until all variables in the queue are uploaded. */
@@ -60,6 +94,8 @@ void CloudClient::waitForUpload()
     while (true) {
         bool found = false;
 
+        impl->connectionsMutex.lock();
+
         for (auto conn : impl->connections) {
             if (conn->queueSize() > 0) {
                 found = true;
@@ -67,10 +103,12 @@ void CloudClient::waitForUpload()
             }
         }
 
+        impl->connectionsMutex.unlock();
+
         if (!found)
             return;
 
-        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        Clock::sleepFor(std::chrono::milliseconds(50));
     }
 }
 
@@ -88,13 +126,75 @@ void CloudClient::setVariableListenMode(const std::string &name, ListenMode mode
     auto it = impl->variablesListenMode.find(name);
 
     if (it == impl->variablesListenMode.cend())
-        std::cout << "variable " << name << " not found in project, but setting listen mode anyway" << std::endl;
+        SCRATCHCLOUD_LOG_INFO("variable " << name << " not found in project, but setting listen mode anyway");
 
     impl->variablesListenMode[name] = mode;
 }
 
-/*! Emits when a variable was set by another user. */
+/*! Sets the store which will be fed with records read from the cloud log. */
+void CloudClient::setCloudLogStore(std::shared_ptr<CloudLogStore> store)
+{
+    impl->listenMutex.lock();
+    impl->cloudLogStore = store;
+    impl->listenMutex.unlock();
+}
+
+/*!
+ * Waits until the setter of a variable received in Hybrid mode is read from the cloud log and returns their username.
+ * Returns an empty string if the username couldn't be read within the timeout (in milliseconds).
+ * \note Don't call this from a slot, incoming messages aren't processed until the slot returns.
+ */
+std::string CloudClient::waitForUser(const CloudEvent &event, int timeout)
+{
+    if (event.impl->listenMode != ListenMode::Hybrid) {
+        SCRATCHCLOUD_LOG_WARNING("waitForUser() is only supported in Hybrid mode");
+        return "";
+    }
+
+    return impl->attributions.waitForUser(event.impl->id, std::chrono::milliseconds(timeout));
+}
+
+/*!
+ * Returns the latency histogram of the given stage since the client was created.
+ * Recording is lock-free, so it's always enabled.
+ */
+LatencySnapshot CloudClient::latency(LatencyStage stage) const
+{
+    // Cloud log requests are made by the poller, which can be shared with other clients
+    if (stage == LatencyStage::CloudLogFetch || stage == LatencyStage::CloudLogParse) {
+        std::shared_ptr<CloudLogPoller> poller = std::atomic_load(&impl->cloudLogPoller);
+        return poller ? poller->latency().snapshot(stage) : LatencySnapshot();
+    }
+
+    return impl->latency.snapshot(stage);
+}
+
+/*! Returns the current values of all metrics (queue depths, sent messages, reconnects, etc.). */
+std::vector<MetricSample> CloudClient::metrics() const
+{
+    return impl->metrics.collect();
+}
+
+/*! Returns the current values of all metrics in the Prometheus text format, e.g. for a /metrics endpoint. */
+std::string CloudClient::metricsText() const
+{
+    return MetricsRegistry::toPrometheus(impl->metrics.collect());
+}
+
+/*! Emits when a variable was set by another user. Slots must not block because they run while incoming messages are processed. */
 sigslot::signal<const CloudEvent &> &CloudClient::variableSet()
 {
     return impl->variableSet;
 }
+
+/*! Emits when a connection is established or lost. The parameter is the number of established connections. */
+sigslot::signal<int> &CloudClient::connectionCountChanged()
+{
+    return impl->connectionCountChanged;
+}
+
+/*! Emits when the setter of a variable received in Hybrid mode is read from the cloud log. The event has the same name and value as the one emitted by variableSet(). */
+sigslot::signal<const CloudEvent &> &CloudClient::variableAttributed()
+{
+    return impl->variableAttributed;
+}
@@ -1,207 +1,852 @@
 // SPDX-License-Identifier: MIT
 
-#include <iostream>
-#include <regex>
 #include <cpr/cpr.h>
 
 #include "cloudclient_p.h"
 #include "cloudconnection.h"
+#include "cloudlogpoller.h"
+#include "cloudlogstore.h"
 #include "cloudevent.h"
+#include "cloudevent_p.h"
+#include "hostresolver.h"
+#include "retry.h"
+#include "tracer.h"
+#include "clock.h"
+#include "logger.h"
 
-#define MAX_LOGIN_ATTEMPTS 32
 #define LISTEN_TIME 100
 #define LOG_UPDATE_INTERVAL 100
-#define LOG_IDLE_TIMEOUT 30000
+#define WS_UPDATE_INTERVAL 25
 #define IDLE_RECONNECT_TIMEOUT 7200000 // 2 hours
+#define POOL_CHECK_INTERVAL 1000
+#define MAX_LISTEN_TIME 1000
 
 using namespace scratchcloud;
 
-CloudClientPrivate::CloudClientPrivate(const std::string &username, const std::string &password, const std::string &projectId, int connections) :
+CloudClientPrivate::CloudClientPrivate(const std::string &username, const std::string &password, const std::string &projectId, const CloudClientOptions &options) :
     username(username),
     password(password),
     projectId(projectId),
-    connectionCount(connections)
+    options(options)
 {
-    login();
+    connectionCount = std::clamp(options.connections, minConnections(), maxConnections());
 
-    if (loginSuccessful)
-        connect();
+    if (options.reactorThreads > 0)
+        loop = EventLoop::shared(options.reactorThreads);
+
+    readyFuture = readyPromise.get_future().share();
+    registerMetrics();
+
+    if (!options.captureFile.empty())
+        capture = std::make_shared<CaptureWriter>(options.captureFile);
+
+    loginBreaker = std::make_shared<CircuitBreaker>(options.retryPolicy);
+    connectBreaker = std::make_shared<CircuitBreaker>(options.retryPolicy);
+
+    if (options.asyncConnect)
+        startThread = std::thread([this]() { start(); });
+    else
+        start();
 }
 
 CloudClientPrivate::~CloudClientPrivate()
 {
-    stopListenThreads = true;
+    // The start thread may still be logging in or connecting
+    stopConnecting = true;
+    stopMaintenance = true;
 
-    if (cloudLogThread.joinable())
-        cloudLogThread.join();
+    if (startThread.joinable())
+        startThread.join();
 
-    if (wsThread.joinable())
-        wsThread.join();
+    stopListening();
+
+    if (maintenanceThread.joinable())
+        maintenanceThread.join();
+
+    // Stop the connections before the relogin thread, an expired session would start it again
+    std::vector<std::shared_ptr<CloudConnection>> oldConnections;
+    connectionsMutex.lock();
+    oldConnections.assign(connections.begin(), connections.end());
+    connectionsMutex.unlock();
+
+    for (auto conn : oldConnections)
+        conn->close();
+
+    reloginMutex.lock();
+
+    if (reloginThread.joinable())
+        reloginThread.join();
+
+    reloginMutex.unlock();
+
+    // The poller can be used by other clients
+    if (capture && cloudLogPoller)
+        cloudLogPoller->setCapture(nullptr);
 }
 
-void CloudClientPrivate::login(int attempt)
+void CloudClientPrivate::registerMetrics()
 {
-    if (attempt > MAX_LOGIN_ATTEMPTS) {
-        std::cerr << "failed to log in after " << attempt << " attempts!" << std::endl;
-        return;
-    }
+    metrics.addGauge("scratchcloud_connections", "Number of established connections", [this]() { return readyConnectionCount.load(); });
+    metrics.addGauge("scratchcloud_pool_size", "Number of connections in the pool (including broken ones)", [this]() {
+        std::lock_guard<std::mutex> lock(connectionsMutex);
+        return connections.size();
+    });
 
-    assert(attempt <= MAX_LOGIN_ATTEMPTS);
-    std::cout << "attempting to log in... (attempt " << attempt << " of " << MAX_LOGIN_ATTEMPTS << ")" << std::endl;
-    loginSuccessful = false;
-    cpr::Url login_url{ "https://scratch.mit.edu/login/" };
-    cpr::Header login_headers{
-        { "x-csrftoken", "a" },
-        { "x-requested-with", "XMLHttpRequest" },
-        { "Cookie", "scratchcsrftoken=a;scratchlanguage=en;" },
-        { "referer", "https://scratch.mit.edu" },
-        { "user-agent", "Mozilla/5.0 (Windows NT 10.0; Win64; x64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/91.0.4472.101 Safari/537.36" }
-    };
-    cpr::Body login_body{ "{ \"username\": \"" + username + "\", \"password\": \"" + password + "\" }" };
-    cpr::Response login_response = cpr::Post(login_url, login_headers, login_body);
+    metrics.addCollector([this](std::vector<MetricSample> &out) {
+        std::lock_guard<std::mutex> lock(connectionsMutex);
+        std::vector<std::pair<int, std::shared_ptr<CloudConnection>>> sorted;
 
-    if (login_response.status_code != 200) {
-        if (login_response.status_code == 403) {
-            std::cerr << "Incorrect username or password!" << std::endl;
-            return;
-        } else {
-            login(attempt + 1);
+        for (auto conn : connections)
+            sorted.push_back({ conn->id(), conn });
+
+        std::sort(sorted.begin(), sorted.end(), [](const auto &a, const auto &b) { return a.first < b.first; });
+
+        for (const auto &[id, conn] : sorted)
+            out.push_back({ "scratchcloud_connection_queue_depth", "Number of messages waiting to be sent", MetricSample::Type::Gauge, { { "connection", std::to_string(id) } }, static_cast<double>(conn->queueSize()) });
+
+        for (const auto &[id, conn] : sorted)
+            out.push_back({ "scratchcloud_connection_latency_ms", "Smoothed round-trip time of the connection", MetricSample::Type::Gauge, { { "connection", std::to_string(id) } }, static_cast<double>(conn->latency()) });
+    });
+
+    metrics.addCounter("scratchcloud_messages_sent_total", "Number of variables sent to the server", &connectionMetrics.messagesSent);
+    metrics.addCounter("scratchcloud_frames_received_total", "Number of Websockets messages received from the server", &connectionMetrics.framesReceived);
+    metrics.addCounter("scratchcloud_parse_errors_total", "Number of invalid lines in received messages", &connectionMetrics.parseErrors);
+    metrics.addCounter("scratchcloud_reconnects_total", "Number of reconnects of single connections", &connectionMetrics.reconnects);
+    metrics.addCounter("scratchcloud_login_attempts_total", "Number of login requests", &loginAttempts);
+    metrics.addCounter("scratchcloud_login_failures_total", "Number of logins which failed after all attempts", &loginFailures);
+    metrics.addCounter("scratchcloud_echo_filtered_total", "Number of Websockets messages skipped because not all connections received them", &echoFiltered);
+
+    // The poller can be shared with other clients
+    metrics.addCollector([this](std::vector<MetricSample> &out) {
+        std::shared_ptr<CloudLogPoller> poller = std::atomic_load(&cloudLogPoller);
+
+        if (!poller)
             return;
+
+        out.push_back({ "scratchcloud_cloudlog_polls_total", "Number of cloud log requests", MetricSample::Type::Counter, {}, static_cast<double>(poller->pollCount()) });
+        out.push_back({ "scratchcloud_cloudlog_poll_errors_total", "Number of failed cloud log requests", MetricSample::Type::Counter, {}, static_cast<double>(poller->pollErrorCount()) });
+        out.push_back({ "scratchcloud_cloudlog_records_total", "Number of new cloud log records", MetricSample::Type::Counter, {}, static_cast<double>(poller->recordCount()) });
+    });
+}
+
+void CloudClientPrivate::start()
+{
+    /*
+     * The Websockets connections need the session ID, but everything else
+     * can be prepared while logging in: resolve the host of the Websockets
+     * server and let the cloud log poller make its initial request.
+     */
+    std::future<std::string> resolved = HostResolver::prefetch(options.websocketUrl);
+
+    // Stored atomically, metrics can be collected on other threads while starting
+    if (!cloudLogPoller)
+        std::atomic_store(&cloudLogPoller, CloudLogPoller::get(projectId, options.retryPolicy, options.cloudLogUrl));
+
+    if (capture)
+        cloudLogPoller->setCapture(capture);
+
+    login();
+    resolved.wait();
+
+    if (loginSuccessful && !stopConnecting)
+        connect();
+    else
+        setReady(false);
+}
+
+static std::string findSessionId(const std::string &header)
+{
+    // The session ID is the first quoted string in the header (including the quotes)
+    std::string::size_type lineStart = 0;
+
+    while (lineStart < header.size()) {
+        std::string::size_type lineEnd = header.find_first_of("\r\n", lineStart);
+
+        if (lineEnd == std::string::npos)
+            lineEnd = header.size();
+
+        std::string::size_type start = header.find('"', lineStart);
+
+        if (start < lineEnd) {
+            std::string::size_type end = header.rfind('"', lineEnd - 1);
+
+            if (end > start)
+                return header.substr(start, end - start + 1);
         }
+
+        lineStart = lineEnd + 1;
     }
 
-    std::smatch login_smatch;
-    std::regex_search(login_response.raw_header, login_smatch, std::regex("\"(.*)\""));
+    return "";
+}
+
+bool CloudClientPrivate::login()
+{
+    loginSuccessful = false;
+    const RetryPolicy &policy = options.retryPolicy;
+    Retry retry(policy, loginBreaker.get());
+
+    bool success = retry.run(
+        [this, &policy](int attempt) {
+            loginAttempts++;
+
+            if (policy.maxAttempts > 0)
+                SCRATCHCLOUD_LOG_INFO("attempting to log in... (attempt " << attempt << " of " << policy.maxAttempts << ")");
+            else
+                SCRATCHCLOUD_LOG_INFO("attempting to log in... (attempt " << attempt << ")");
+
+            const std::string &login_url = options.loginUrl;
+            cpr::Header login_headers{
+                { "x-csrftoken", "a" },
+                { "x-requested-with", "XMLHttpRequest" },
+                { "Cookie", "scratchcsrftoken=a;scratchlanguage=en;" },
+                { "referer", "https://scratch.mit.edu" },
+                { "user-agent", "Mozilla/5.0 (Windows NT 10.0; Win64; x64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/91.0.4472.101 Safari/537.36" }
+            };
+            cpr::Body login_body{ "{ \"username\": \"" + username + "\", \"password\": \"" + password + "\" }" };
+            cpr::Session session;
+            session.SetUrl(cpr::Url(login_url));
+            session.SetHeader(login_headers);
+            session.SetBody(login_body);
+            HostResolver::applyTo(session, login_url);
+            cpr::Response login_response = session.Post();
+
+            if (login_response.status_code != 200) {
+                if (login_response.status_code == 403) {
+                    SCRATCHCLOUD_LOG_ERROR("Incorrect username or password!");
+                    return Retry::Result::Fatal;
+                }
+
+                return Retry::Result::Failure;
+            }
+
+            try {
+                std::string newSessionId = findSessionId(login_response.raw_header);
+                std::string newToken = nlohmann::json::parse(login_response.text)[0]["token"];
+
+                std::lock_guard<std::mutex> lock(sessionMutex);
+                sessionId = newSessionId;
+                xToken = newToken;
+            } catch (std::exception &e) {
+                SCRATCHCLOUD_LOG_ERROR("invalid login response: " << e.what());
+                return Retry::Result::Failure;
+            }
+
+            return Retry::Result::Success;
+        },
+        &stopConnecting);
+
+    if (!success) {
+        loginFailures++;
+        SCRATCHCLOUD_LOG_ERROR("failed to log in!");
+        return false;
+    }
 
-    sessionId = login_smatch[0];
-    xToken = nlohmann::json::parse(login_response.text)[0]["token"];
     loginSuccessful = true;
-    std::cout << "success!" << std::endl;
-    return;
+    SCRATCHCLOUD_LOG_INFO("success!");
+    return true;
 }
 
 void CloudClientPrivate::connect() {
     // Stop running threads
-    stopListenThreads = true;
-
-    if (cloudLogThread.joinable())
-        cloudLogThread.join();
-
-    if (wsThread.joinable())
-        wsThread.join();
+    stopListening();
 
-    stopListenThreads = false;
+    if (!cloudLogPoller)
+        std::atomic_store(&cloudLogPoller, CloudLogPoller::get(projectId, options.retryPolicy, options.cloudLogUrl));
 
     // Create connections
-    const int threadCount = std::thread::hardware_concurrency();
-    std::mutex connectionMutex;
+    connectionsMutex.lock();
     connections.clear();
+    connectionsMutex.unlock();
+
+    listenMutex.lock();
+    receivedMessages.clear();
+    readyConnections.clear();
+    lostConnections.clear();
+    slowConnections.clear();
+    rejoiningConnections.clear();
+    listenMutex.unlock();
 
-    auto f = [this, &connectionMutex](int id) {
-        std::cout << id << ": connecting..." << std::endl;
-        auto conn = std::make_shared<CloudConnection>(id, username, sessionId, projectId);
-        conn->variableSet().connect([conn, this](const std::string &name, const std::string &value) { processEvent(conn.get(), name, value); });
+    readyConnectionCount = 0;
+    connected = false;
 
-        connectionMutex.lock();
-        connections.insert(conn);
-        connectionMutex.unlock();
+    /*
+     * Each worker connects the next pending connection as soon as its previous
+     * one is done, so that a fixed number of handshakes is always in progress
+     * and a single slow socket doesn't stall the others.
+     */
+    std::atomic<int> nextId = 0;
+    nextConnectionId = connectionCount.load();
+
+    auto f = [this, &nextId]() {
+        int id;
+
+        while (!stopConnecting && (id = nextId++) < connectionCount) {
+            auto conn = createConnection(id);
+
+            connectionsMutex.lock();
+            connections.insert(conn);
+            connectionsMutex.unlock();
+
+            if (conn->connected())
+                addReadyConnection(conn.get());
+        }
     };
 
+    int threadCount = options.maxPendingConnections > 0 ? options.maxPendingConnections : std::thread::hardware_concurrency();
+    threadCount = std::max(1, std::min(threadCount, connectionCount.load()));
     std::vector<std::thread> threads;
-    bool done = false;
-    int i = 0;
 
-    while (true) {
-        threads.clear();
+    for (int i = 0; i < threadCount; i++)
+        threads.push_back(std::thread(f));
 
-        for (int j = 0; j < threadCount; j++) {
-            if (i >= connectionCount) {
-                done = true;
-                break;
-            }
+    for (auto &thread : threads)
+        thread.join();
+
+    // Check connection status
+    if (readyConnectionCount < readyThreshold()) {
+        setReady(false);
+        return;
+    }
+
+    if (readyConnectionCount == connectionCount) {
+        connected = true;
+        SCRATCHCLOUD_LOG_INFO("connected!");
+    }
+}
+
+std::shared_ptr<CloudConnection> CloudClientPrivate::createConnection(int id, bool ignoreHandshake)
+{
+    SCRATCHCLOUD_LOG_INFO(id << ": connecting...");
+
+    sessionMutex.lock();
+    std::string session = sessionId;
+    sessionMutex.unlock();
+
+    auto conn = std::make_shared<CloudConnection>(id, options.websocketUrl, username, session, projectId, loop, options.retryPolicy, connectBreaker, options.pingInterval, ignoreHandshake, &stopConnecting);
+    CloudConnection *connPtr = conn.get(); // capturing the shared pointer would keep the connection alive
+    conn->setLatencyRecorder(&latency);
+    conn->setMetrics(&connectionMetrics);
+    conn->setCapture(capture.get());
+    conn->variableSet().connect([connPtr, this](const std::string &name, const std::string &value) { processEvent(connPtr, name, value); });
+    conn->connectionLost().connect([connPtr, this]() { removeReadyConnection(connPtr); });
+    conn->connectionRestored().connect([connPtr, this]() { addReadyConnection(connPtr); });
+    conn->authenticationFailed().connect([this]() { relogin(); });
+
+    return conn;
+}
+
+void CloudClientPrivate::addReadyConnection(CloudConnection *connection)
+{
+    listenMutex.lock();
+
+    if (!readyConnections.insert(connection).second) {
+        listenMutex.unlock();
+        return;
+    }
+
+    /*
+     * A connection which joins while listening (restored, added to the pool or replacing
+     * another one) only takes part in the next reconciliation. Otherwise the messages
+     * the other connections received before it joined would be filtered.
+     */
+    lostConnections.erase(connection);
+
+    if (listening)
+        rejoiningConnections.push_back(connection);
+    else
+        receivedMessages[connection];
+
+    int count = ++readyConnectionCount;
+    listenMutex.unlock();
+
+    connected = (count >= connectionCount);
+    connectionCountChanged(count);
+
+    // Start listening as soon as the client is usable
+    if (count >= readyThreshold() && !listenersStarted.exchange(true)) {
+        startListening();
+        setReady(true);
+    }
+}
+
+void CloudClientPrivate::removeReadyConnection(CloudConnection *connection)
+{
+    // Messages received by this connection can't be reconciled until it's restored
+    listenMutex.lock();
+    lostConnections.insert(connection);
+    slowConnections.erase(connection);
+    receivedMessages.erase(connection);
+    rejoiningConnections.erase(std::remove(rejoiningConnections.begin(), rejoiningConnections.end(), connection), rejoiningConnections.end());
+
+    if (readyConnections.erase(connection) > 0) {
+        int count = --readyConnectionCount;
+        listenMutex.unlock();
+
+        connected = (count >= connectionCount);
+        connectionCountChanged(count);
+    } else
+        listenMutex.unlock();
+
+    // Send the pending messages using the other connections
+    for (const auto &request : connection->takeQueue())
+        uploadVar(request);
+}
+
+void CloudClientPrivate::setConnectionSlow(CloudConnection *connection, bool slow)
+{
+    listenMutex.lock();
 
-            threads.push_back(std::thread(f, i));
-            i++;
+    if (slow) {
+        // Late echoes of a slow connection would make the others' messages look like our own
+        if (slowConnections.insert(connection).second) {
+            receivedMessages.erase(connection);
+            rejoiningConnections.erase(std::remove(rejoiningConnections.begin(), rejoiningConnections.end(), connection), rejoiningConnections.end());
         }
+    } else if (slowConnections.erase(connection) > 0 && readyConnections.find(connection) != readyConnections.end()) {
+        // Same as a connection which joins the pool
+        if (listening)
+            rejoiningConnections.push_back(connection);
+        else
+            receivedMessages[connection];
+    }
+
+    listenMutex.unlock();
+}
+
+void CloudClientPrivate::refreshConnections()
+{
+    std::vector<std::shared_ptr<CloudConnection>> oldConnections;
 
-        for (int i = 0; i < threads.size(); i++)
-            threads[i].join();
+    connectionsMutex.lock();
+    oldConnections.assign(connections.begin(), connections.end());
+    connectionsMutex.unlock();
 
-        if (done)
+    replaceConnections(oldConnections);
+}
+
+void CloudClientPrivate::replaceConnections(const std::vector<std::shared_ptr<CloudConnection>> &oldConnections)
+{
+    /*
+     * Replace the connections one by one. The old connection is closed only after
+     * the new one is ready, so the client can send and receive messages the whole time.
+     */
+    for (auto &oldConn : oldConnections) {
+        if (stopMaintenance)
             break;
+
+        auto conn = createConnection(nextConnectionId++, true);
+
+        if (stopMaintenance)
+            break;
+
+        if (!conn->connected()) {
+            // Keep the old connection for now
+            SCRATCHCLOUD_LOG_WARNING(oldConn->id() << ": failed to open a replacement connection");
+            continue;
+        }
+
+        connectionsMutex.lock();
+        connections.insert(conn);
+        connectionsMutex.unlock();
+
+        addReadyConnection(conn.get());
+        retireConnection(oldConn);
     }
+}
+
+void CloudClientPrivate::retireConnection(std::shared_ptr<CloudConnection> connection)
+{
+    // Close the connection and send its pending messages using the other ones
+    connection->close();
+
+    connectionsMutex.lock();
+    connections.erase(connection);
+    connectionsMutex.unlock();
+
+    removeReadyConnection(connection.get());
+
+    listenMutex.lock();
+    lostConnections.erase(connection.get());
+    listenMutex.unlock();
+}
+
+int CloudClientPrivate::minConnections() const
+{
+    int min = options.minConnections > 0 ? options.minConnections : options.connections;
+    return std::max(1, std::min(min, options.connections));
+}
+
+int CloudClientPrivate::maxConnections() const
+{
+    return std::max(options.maxConnections, options.connections);
+}
+
+void CloudClientPrivate::checkConnections()
+{
+    auto now = Clock::now();
+    int maxLatency = 0;
+    std::vector<std::shared_ptr<CloudConnection>> replacedConnections;
+    std::vector<CloudConnection *> fastConnections;
+    std::unordered_map<CloudConnection *, TimePoint> stillSlow;
+
+    connectionsMutex.lock();
 
-    // Check connection status
     for (auto conn : connections) {
         if (!conn->connected())
-            return;
+            continue;
 
-        receivedMessages[conn.get()] = {};
+        int latency = conn->latency();
+
+        if (latency < options.slowConnectionLatency) {
+            maxLatency = std::max(maxLatency, latency);
+            fastConnections.push_back(conn.get());
+            continue;
+        }
+
+        // Replace connections which stay slow
+        auto it = slowSince.find(conn.get());
+        TimePoint since = (it == slowSince.end()) ? now : it->second;
+
+        if (std::chrono::duration_cast<std::chrono::milliseconds>(now - since).count() >= options.slowConnectionTime)
+            replacedConnections.push_back(conn);
+        else
+            stillSlow[conn.get()] = since;
     }
 
-    cloudLogThread = std::thread([&]() { listenToCloudLog(); });
-    wsThread = std::thread([&]() { listenToMessages(); });
-    connected = true;
-    std::cout << "connected!" << std::endl;
+    connectionsMutex.unlock();
+    slowSince.swap(stillSlow);
+
+    // Slow connections don't take part in the reconciliation until they're replaced or recover
+    for (auto conn : replacedConnections)
+        setConnectionSlow(conn.get(), true);
+
+    for (CloudConnection *conn : fastConnections)
+        setConnectionSlow(conn, false);
+
+    /*
+     * Echoes of a message reach the connections with different delays,
+     * so the slowest (healthy) connection determines the listen time.
+     */
+    listenTime = std::clamp(maxLatency, LISTEN_TIME, MAX_LISTEN_TIME);
+
+    if (!replacedConnections.empty()) {
+        SCRATCHCLOUD_LOG_WARNING("replacing " << replacedConnections.size() << " slow connection(s)");
+        startMaintenance([this, replacedConnections]() { replaceConnections(replacedConnections); });
+    }
 }
 
-void CloudClientPrivate::reconnect() {
-    do {
-        login();
-    } while (!loginSuccessful);
+void CloudClientPrivate::resizePool()
+{
+    auto now = Clock::now();
+    int size = 0;
+    int queued = 0;
+    int maxDelay = 0;
 
-    do {
-        connect();
-    } while (!connected);
+    connectionsMutex.lock();
+
+    // Connections which are down retry in the background, they don't count until they're back
+    for (auto conn : connections) {
+        if (conn->connected()) {
+            size++;
+            queued += conn->queueSize();
+            maxDelay = std::max(maxDelay, conn->queueDelay());
+        }
+    }
+
+    connectionsMutex.unlock();
+
+    if (queued > 0)
+        lastBusy = now;
+
+    auto idleTime = std::chrono::duration_cast<std::chrono::milliseconds>(now - lastBusy).count();
+    int growThreshold = std::max(1, options.growQueueThreshold);
+
+    if (size < maxConnections() && (queued > growThreshold * size || maxDelay >= options.growDelayThreshold)) {
+        // Open enough connections for the backlog (at least one)
+        int count = std::min(maxConnections() - size, std::max(1, queued / growThreshold - size));
+        startMaintenance([this, count]() { growPool(count); });
+    } else if (size > minConnections() && idleTime >= options.shrinkIdleTime)
+        startMaintenance([this]() { shrinkPool(); });
+}
+
+void CloudClientPrivate::growPool(int count)
+{
+    for (int i = 0; i < count && !stopMaintenance; i++) {
+        auto conn = createConnection(nextConnectionId++, true);
+
+        if (stopMaintenance || !conn->connected())
+            break;
+
+        connectionsMutex.lock();
+        connections.insert(conn);
+        connectionsMutex.unlock();
+
+        connectionCount++;
+        addReadyConnection(conn.get());
+    }
+
+    rebalanceQueues();
+}
+
+void CloudClientPrivate::shrinkPool()
+{
+    // Close the connection with the least pending messages (prefer broken connections)
+    std::shared_ptr<CloudConnection> conn;
+    int min = 0;
+    bool minConnected = true;
+
+    connectionsMutex.lock();
+
+    for (auto c : connections) {
+        bool connected = c->connected();
+        int size = c->queueSize();
+
+        if (!conn || (!connected && minConnected) || (connected == minConnected && size < min)) {
+            conn = c;
+            min = size;
+            minConnected = connected;
+        }
+    }
+
+    connectionsMutex.unlock();
+
+    if (conn) {
+        connectionCount--;
+        retireConnection(conn);
+    }
+}
+
+void CloudClientPrivate::rebalanceQueues()
+{
+    std::vector<CloudConnection::UploadRequest> requests;
+
+    connectionsMutex.lock();
+
+    for (auto conn : connections) {
+        auto queue = conn->takeQueue();
+        requests.insert(requests.end(), queue.begin(), queue.end());
+    }
+
+    connectionsMutex.unlock();
+
+    // Queue the messages again (the oldest ones first), so that they're spread across all connections
+    std::stable_sort(requests.begin(), requests.end(), [](const CloudConnection::UploadRequest &a, const CloudConnection::UploadRequest &b) { return a.enqueueTime < b.enqueueTime; });
+
+    for (const auto &request : requests)
+        uploadVar(request);
+}
+
+void CloudClientPrivate::startMaintenance(std::function<void()> f)
+{
+    // Connections are added and removed by one thread at a time
+    if (stopMaintenance || maintaining.exchange(true))
+        return;
+
+    if (maintenanceThread.joinable())
+        maintenanceThread.join();
+
+    maintenanceThread = std::thread([this, f]() {
+        f();
+        maintaining = false;
+    });
+}
+
+void CloudClientPrivate::relogin()
+{
+    std::lock_guard<std::mutex> lock(reloginMutex);
+
+    // The session is shared by all connections, so it's renewed only once
+    if (stopConnecting || relogging.exchange(true))
+        return;
+
+    if (reloginThread.joinable())
+        reloginThread.join();
+
+    reloginThread = std::thread([this]() {
+        if (login()) {
+            sessionMutex.lock();
+            std::string session = sessionId;
+            sessionMutex.unlock();
+
+            std::lock_guard<std::mutex> lock(connectionsMutex);
+
+            for (auto conn : connections) {
+                conn->setSessionId(session);
+
+                if (!conn->connected())
+                    conn->requestReconnect();
+            }
+        }
+
+        relogging = false;
+    });
+}
+
+int CloudClientPrivate::readyThreshold() const
+{
+    if (options.readyConnections <= 0)
+        return connectionCount;
+
+    return std::min(options.readyConnections, connectionCount.load());
+}
+
+void CloudClientPrivate::setReady(bool ready)
+{
+    std::lock_guard<std::mutex> lock(readyMutex);
+
+    // The future is only set once (reconnects don't change it)
+    if (!readySet) {
+        readySet = true;
+        readyPromise.set_value(ready);
+    }
 }
 
 void CloudClientPrivate::uploadVar(const std::string &name, const std::string &value)
 {
-    // Pick the least overloaded connection
+    uploadVar({ name, value, Clock::now() });
+}
+
+void CloudClientPrivate::uploadVar(const CloudConnection::UploadRequest &request)
+{
+    // Pick the connection which will send the message first (prefer connected ones)
     int min = 0;
+    bool minConnected = false;
     std::shared_ptr<CloudConnection> conn = nullptr;
 
+    connectionsMutex.lock();
+
     for (auto c : connections) {
-        if (!conn || c->queueSize() < min) {
+        bool connected = c->connected();
+        int score = c->healthScore();
+
+        if (!conn || (connected && !minConnected) || (connected == minConnected && score < min)) {
             conn = c;
-            min = c->queueSize();
+            min = score;
+            minConnected = connected;
         }
     }
 
+    connectionsMutex.unlock();
+
     if (conn) {
-        conn->uploadVar(name, value);
+        conn->uploadVar(request);
 
         listenMutex.lock();
-        lastUpload = std::chrono::steady_clock::now();
+        lastUpload = Clock::now();
         listenMutex.unlock();
     }
 }
 
-void CloudClientPrivate::listenToCloudLog()
+void CloudClientPrivate::startListening()
 {
-    // Get initial log to avoid notifying about outdated events
+    stopListenThreads = false;
+    lastWsActivity = Clock::now();
+    lastUpload = lastWsActivity.load();
+    listenTime = LISTEN_TIME;
+    lastBusy = lastUpload;
+    lastPoolCheck = lastUpload;
+
+    // The log is fetched by a poller shared with other clients connected to the same project
+    cloudLogSubscription = cloudLogPoller->subscribe();
+
+    if (loop) {
+        // Listen using timers of the shared event loop
+        cloudLogTimer = loop->scheduleRepeating(std::chrono::milliseconds(LOG_UPDATE_INTERVAL), [this]() {
+            if (!stopListenThreads)
+                readCloudLog(std::chrono::milliseconds(0));
+        });
+
+        wsTimer = loop->scheduleRepeating(std::chrono::milliseconds(WS_UPDATE_INTERVAL), [this]() {
+            if (!stopListenThreads)
+                listenToMessages();
+        });
+    } else {
+        cloudLogThread = std::thread([this]() {
+            while (!stopListenThreads)
+                readCloudLog(std::chrono::milliseconds(LOG_UPDATE_INTERVAL));
+        });
+
+        wsThread = std::thread([this]() {
+            while (!stopListenThreads) {
+                auto start = Clock::now();
+                listenToMessages();
+                auto delta = std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - start).count();
+                Clock::sleepFor(std::chrono::milliseconds(std::max(0L, WS_UPDATE_INTERVAL - delta)));
+            }
+        });
+    }
+}
+
+void CloudClientPrivate::stopListening()
+{
+    stopListenThreads = true;
+    listenersStarted = false;
+
+    if (loop) {
+        loop->cancel(cloudLogTimer);
+        loop->cancel(wsTimer);
+    }
+
+    if (cloudLogThread.joinable())
+        cloudLogThread.join();
+
+    if (wsThread.joinable())
+        wsThread.join();
+
+    if (cloudLogSubscription) {
+        cloudLogPoller->unsubscribe(cloudLogSubscription);
+        cloudLogSubscription.reset();
+    }
+}
+
+void CloudClientPrivate::readCloudLog(std::chrono::milliseconds timeout)
+{
+    // The poller doesn't fetch the log if there haven't been any WS messages recently
+    cloudLogSubscription->lastActivity = lastWsActivity.load();
     std::vector<CloudLogRecord> log;
-    getCloudLog(log);
 
-    while (!stopListenThreads) {
-        listenMutex.lock();
-        auto now = std::chrono::steady_clock::now();
-        auto delta = std::chrono::duration_cast<std::chrono::milliseconds>(now - lastWsActivity).count();
-        listenMutex.unlock();
+    if (cloudLogPoller->read(*cloudLogSubscription, log, timeout))
+        processCloudLog(log);
+
+    attributions.expire();
+}
+
+void CloudClientPrivate::processCloudLog(const std::vector<CloudLogRecord> &log)
+{
+    // Match Hybrid events before locking, so that slots can wait for the user
+    for (const auto &record : log) {
+        // Variables set by this client aren't received using Websockets
+        if (record.user() == username)
+            continue;
+
+        unsigned long id = attributions.match(record.name(), record.value(), record.timestamp(), record.user());
+
+        if (id != 0) {
+            CloudEvent event(CloudClient::ListenMode::Hybrid, record.user(), record.name(), record.value());
+            event.impl->id = id;
+            variableAttributed(event);
+        }
+    }
+
+    listenMutex.lock();
 
-        // Do not fetch log if there haven't been any WS messages recently
-        if (delta < LOG_IDLE_TIMEOUT) {
-            std::vector<CloudLogRecord> log;
-            getCloudLog(log);
-            listenMutex.lock();
+    for (const auto &record : log)
+        notifyAboutVar(CloudClient::ListenMode::CloudLog, record.user(), record.name(), record.value());
 
-            for (const auto &record : log)
-                notifyAboutVar(CloudClient::ListenMode::CloudLog, record.user(), record.name(), record.value());
+    std::shared_ptr<CloudLogStore> store = cloudLogStore;
+    listenMutex.unlock();
+
+    // Write to the disk without blocking the Websockets messages
+    if (store) {
+        std::vector<CloudLogStore::Record> records;
 
-            listenMutex.unlock();
+        for (const auto &record : log) {
+            if (record.type() == CloudLogRecord::Type::SetVar)
+                records.push_back({ record.user(), record.name(), record.value(), record.timestamp() });
         }
 
-        std::this_thread::sleep_for(std::chrono::milliseconds(LOG_UPDATE_INTERVAL));
+        store->append(records);
     }
 }
 
@@ -213,83 +858,105 @@ void CloudClientPrivate::listenToMessages()
      * messages for some time and then determine which messages should be
      * filtered (messages sent by a client are not returned to it).
      */
-    lastWsActivity = std::chrono::steady_clock::now();
-    lastUpload = lastWsActivity;
+    listenMutex.lock();
 
-    while (!stopListenThreads) {
-        listenMutex.lock();
-        int sleepTime = 25;
+    if (listening) {
+        auto now = Clock::now();
+        auto delta = std::chrono::duration_cast<std::chrono::milliseconds>(now - listenStartTime).count();
+
+        if (delta >= listenTime) {
+            latency.record(LatencyStage::Reconciliation, listenStartTime);
+            SCRATCHCLOUD_TRACE_SINCE("client", "reconciliation", listenStartTime);
+            SCRATCHCLOUD_TRACE_SCOPE("client", "dispatch");
 
-        if (listening) {
-            auto now = std::chrono::steady_clock::now();
-            auto delta = std::chrono::duration_cast<std::chrono::milliseconds>(now - listenStartTime).count();
+            auto start = Clock::now();
+            std::vector<std::pair<std::string, std::string>> messages;
+            echoFiltered += reconcileMessages(receivedMessages, messages);
+            latency.record(LatencyStage::Dispatch, start);
 
-            if (delta >= LISTEN_TIME) {
-                // Create a list of distinct messages (duplicate messages in a single connection are allowed)
-                std::vector<std::pair<std::string, std::string>> distinctMessages;
+            for (const auto &message : messages) {
+                // NOTE: Setter username can't be read from WS messages
+                notifyAboutVar(CloudClient::ListenMode::Websockets, "", message.first, message.second);
+                lastWsActivity = Clock::now();
+            }
 
-                for (const auto &[conn, list] : receivedMessages) {
-                    std::vector<std::pair<std::string, std::string>> newMessages;
+            // Clear received messages
+            for (auto &[conn, list] : receivedMessages)
+                list.clear();
 
-                    for (const auto &message : list) {
-                        if (std::find(distinctMessages.begin(), distinctMessages.end(), message) == distinctMessages.end())
-                            newMessages.push_back(message);
-                    }
+            for (CloudConnection *conn : rejoiningConnections)
+                receivedMessages[conn];
 
-                    for (const auto &message : newMessages)
-                        distinctMessages.push_back(message);
-                }
+            rejoiningConnections.clear();
 
-                // Notify about messages which are present in the same count in all connections
-                for (const auto &message : distinctMessages) {
-                    bool skip = false;
-                    int count = -1;
+            listening = false;
+        }
+    }
 
-                    for (const auto &[conn, list] : receivedMessages) {
-                        int currentCount = std::count(list.begin(), list.end(), message);
+    listenMutex.unlock();
 
-                        if ((count != -1 && currentCount != count) || currentCount == 0) {
-                            // This message should be skipped
-                            skip = true;
-                            break;
-                        }
+    auto now = Clock::now();
+    auto listenIdleTime = std::chrono::duration_cast<std::chrono::milliseconds>(now - lastWsActivity.load()).count();
+    auto uploadIdleTime = std::chrono::duration_cast<std::chrono::milliseconds>(now - lastUpload).count();
+
+    if (listenIdleTime >= IDLE_RECONNECT_TIMEOUT && uploadIdleTime >= IDLE_RECONNECT_TIMEOUT && !maintaining) {
+        /*
+         * Refresh the connections in the background. The session is still valid, so there's
+         * no need to log in again (connections which fail to authenticate will do that).
+         */
+        lastWsActivity = now;
+        startMaintenance([this]() { refreshConnections(); });
+    } else if (std::chrono::duration_cast<std::chrono::milliseconds>(now - lastPoolCheck).count() >= POOL_CHECK_INTERVAL) {
+        lastPoolCheck = now;
+        checkConnections();
+        resizePool();
+    }
+}
 
-                        count = currentCount;
-                    }
+int CloudClientPrivate::reconcileMessages(const ReceivedMessages &receivedMessages, std::vector<std::pair<std::string, std::string>> &out)
+{
+    // Returns the number of skipped messages
+    int skipped = 0;
 
-                    if (!skip) {
-                        // NOTE: Setter username can't be read from WS messages
-                        notifyAboutVar(CloudClient::ListenMode::Websockets, "", message.first, message.second);
-                        lastWsActivity = std::chrono::steady_clock::now();
-                    }
-                }
+    // Create a list of distinct messages (duplicate messages in a single connection are allowed)
+    std::vector<std::pair<std::string, std::string>> distinctMessages;
 
-                // Clear received messages
-                for (auto &[conn, list] : receivedMessages)
-                    list.clear();
+    for (const auto &[conn, list] : receivedMessages) {
+        std::vector<std::pair<std::string, std::string>> newMessages;
 
-                listening = false;
-                delta = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - now).count();
-                sleepTime = std::max(0L, sleepTime - delta);
-            }
+        for (const auto &message : list) {
+            if (std::find(distinctMessages.begin(), distinctMessages.end(), message) == distinctMessages.end())
+                newMessages.push_back(message);
         }
 
-        listenMutex.unlock();
-        std::this_thread::sleep_for(std::chrono::milliseconds(sleepTime));
+        for (const auto &message : newMessages)
+            distinctMessages.push_back(message);
+    }
 
-        auto now = std::chrono::steady_clock::now();
-        auto listenIdleTime = std::chrono::duration_cast<std::chrono::milliseconds>(now - lastWsActivity).count();
-        auto uploadIdleTime = std::chrono::duration_cast<std::chrono::milliseconds>(now - lastUpload).count();
+    // Keep messages which are present in the same count in all connections
+    for (const auto &message : distinctMessages) {
+        bool skip = false;
+        int count = -1;
 
+        for (const auto &[conn, list] : receivedMessages) {
+            int currentCount = std::count(list.begin(), list.end(), message);
 
-        if (listenIdleTime >= IDLE_RECONNECT_TIMEOUT && uploadIdleTime >= IDLE_RECONNECT_TIMEOUT) {
-            if (reconnectThread.joinable())
-                reconnectThread.join();
+            if ((count != -1 && currentCount != count) || currentCount == 0) {
+                // This message should be skipped
+                skip = true;
+                break;
+            }
 
-            reconnectThread = std::thread([&]() { reconnect(); });
-            break;
+            count = currentCount;
         }
+
+        if (!skip)
+            out.push_back(message);
+        else
+            skipped++;
     }
+
+    return skipped;
 }
 
 void CloudClientPrivate::notifyAboutVar(CloudClient::ListenMode srcMode, const std::string &user, const std::string &name, const std::string &value)
@@ -297,10 +964,24 @@ void CloudClientPrivate::notifyAboutVar(CloudClient::ListenMode srcMode, const s
     if (variables.find(name) == variables.cend())
         variablesListenMode[name] = defaultListenMode;
 
-    if (variablesListenMode[name] == srcMode) {
+    CloudClient::ListenMode mode = variablesListenMode[name];
+
+    if (mode == srcMode) {
         variables[name] = value;
         CloudEvent event(srcMode, user, name, value);
+        SCRATCHCLOUD_TRACE_SCOPE("client", "slot");
+        auto start = Clock::now();
         variableSet(event);
+        latency.record(LatencyStage::SlotComplete, start);
+    } else if (mode == CloudClient::ListenMode::Hybrid && srcMode == CloudClient::ListenMode::Websockets) {
+        // Notify immediately, the user will be read from the cloud log later
+        variables[name] = value;
+        CloudEvent event(CloudClient::ListenMode::Hybrid, "", name, value);
+        event.impl->id = attributions.add(name, value);
+        SCRATCHCLOUD_TRACE_SCOPE("client", "slot");
+        auto start = Clock::now();
+        variableSet(event);
+        latency.record(LatencyStage::SlotComplete, start);
     }
 }
 
@@ -308,50 +989,24 @@ void CloudClientPrivate::processEvent(CloudConnection *connection, const std::st
 {
     listenMutex.lock();
 
+    /*
+     * Connections which aren't ready, are down, slow or rejoining don't take part in the reconciliation.
+     * The only exception are the initial connections, which all receive the same list of variables.
+     */
+    bool ready = readyConnections.find(connection) != readyConnections.end();
+    bool rejoining = std::find(rejoiningConnections.begin(), rejoiningConnections.end(), connection) != rejoiningConnections.end();
+    bool excluded = lostConnections.find(connection) != lostConnections.end() || slowConnections.find(connection) != slowConnections.end();
+
+    if ((!ready && listenersStarted) || rejoining || excluded) {
+        listenMutex.unlock();
+        return;
+    }
+
     if (!listening) {
         listening = true;
-        listenStartTime = std::chrono::steady_clock::now();
+        listenStartTime = Clock::now();
     }
 
     receivedMessages[connection].push_back({ name, value });
     listenMutex.unlock();
 }
-
-void CloudClientPrivate::getCloudLog(std::vector<CloudLogRecord> &out, int limit, int offset)
-{
-    out.clear();
-
-    std::string url = "https://clouddata.scratch.mit.edu/logs?projectid=";
-    url += projectId;
-    url += "&limit=";
-    url += std::to_string(limit);
-    url += "&offset=";
-    url += std::to_string(offset);
-    cpr::Response response = cpr::Get(cpr::Url(url));
-
-    if (response.status_code == 200) {
-        try {
-            nlohmann::json json = nlohmann::json::parse(response.text);
-            long maxTimestamp = 0;
-
-            for (auto jsonRecord : json) {
-                CloudLogRecord record(jsonRecord);
-
-                if (record.type() != CloudLogRecord::Type::Invalid) {
-                    maxTimestamp = std::max(maxTimestamp, record.timestamp());
-
-                    if (record.timestamp() > cloudLogReadTime)
-                        out.push_back(record);
-                }
-            }
-
-            cloudLogReadTime = maxTimestamp;
-
-            // We want the latest record to be last
-            std::reverse(out.begin(), out.end());
-        } catch (std::exception &e) {
-            std::cerr << "invalid cloud log: " << response.text << std::endl;
-        }
-    } else
-        std::cerr << "failed to get cloud log: " << response.status_code << std::endl;
-}
@@ -5,60 +5,137 @@
 #include <unordered_map>
 #include <string>
 #include <set>
+#include <future>
+#include <functional>
 
 #include "signal.h"
 #include "cloudlogrecord.h"
+#include "cloudlogpoller.h"
+#include "attributionmatcher.h"
+#include "eventloop.h"
+#include "latencyhistogram.h"
+#include "metrics.h"
+#include "capture.h"
+#include "cloudconnection.h"
 #include "cloudclient.h"
 
 namespace scratchcloud
 {
 
-class CloudConnection;
+class CircuitBreaker;
+class CloudLogStore;
 
 struct CloudClientPrivate
 {
         using TimePoint = std::chrono::steady_clock::time_point;
+        using ReceivedMessages = std::unordered_map<CloudConnection *, std::vector<std::pair<std::string, std::string>>>;
 
-        CloudClientPrivate(const std::string &username, const std::string &password, const std::string &projectId, int connections);
+        CloudClientPrivate(const std::string &username, const std::string &password, const std::string &projectId, const CloudClientOptions &options);
         CloudClientPrivate(const CloudClientPrivate &) = delete;
         ~CloudClientPrivate();
 
-        void login(int attempt = 1);
+        void registerMetrics();
+        void start();
+        bool login();
         void connect();
-        void reconnect();
+        std::shared_ptr<CloudConnection> createConnection(int id, bool ignoreHandshake = false);
+        void refreshConnections();
+        void replaceConnections(const std::vector<std::shared_ptr<CloudConnection>> &oldConnections);
+        void checkConnections();
+        void retireConnection(std::shared_ptr<CloudConnection> connection);
+        int minConnections() const;
+        int maxConnections() const;
+        void resizePool();
+        void growPool(int count);
+        void shrinkPool();
+        void rebalanceQueues();
+        void startMaintenance(std::function<void()> f);
+        void relogin();
+
+        void addReadyConnection(CloudConnection *connection);
+        void removeReadyConnection(CloudConnection *connection);
+        void setConnectionSlow(CloudConnection *connection, bool slow);
+        int readyThreshold() const;
+        void setReady(bool ready);
+
+        void startListening();
+        void stopListening();
 
         void uploadVar(const std::string &name, const std::string &value);
-        void listenToCloudLog();
+        void uploadVar(const CloudConnection::UploadRequest &request);
+        void readCloudLog(std::chrono::milliseconds timeout);
+        void processCloudLog(const std::vector<CloudLogRecord> &log);
         void listenToMessages();
+        static int reconcileMessages(const ReceivedMessages &receivedMessages, std::vector<std::pair<std::string, std::string>> &out);
         void notifyAboutVar(CloudClient::ListenMode srcMode, const std::string &user, const std::string &name, const std::string &value);
         void processEvent(CloudConnection *connection, const std::string &name, const std::string &value);
 
-        void getCloudLog(std::vector<CloudLogRecord> &out, int limit = 25, int offset = 0);
-
         std::string username;
         std::string password;
         std::string sessionId;
         std::string xToken;
+        std::mutex sessionMutex; // the session is renewed while connections are being created
         std::string projectId;
-        int connectionCount = 0;
-        bool loginSuccessful = false;
-        bool connected = false;
+        CloudClientOptions options;
+        std::atomic<int> connectionCount = 0; // changes when the pool grows or shrinks
+        std::atomic<bool> loginSuccessful = false;
+        std::atomic<bool> connected = false;
+        LatencyRecorder latency; // declared before the connections, which use it
+        ConnectionMetrics connectionMetrics;
+        std::atomic<long> loginAttempts = 0;
+        std::atomic<long> loginFailures = 0;
+        std::atomic<long> echoFiltered = 0;
+        MetricsRegistry metrics;
+        std::shared_ptr<CaptureWriter> capture; // declared before the connections, which use it
         std::set<std::shared_ptr<CloudConnection>> connections;
+        std::mutex connectionsMutex;
+        std::atomic<int> readyConnectionCount = 0;
+        std::promise<bool> readyPromise;
+        std::shared_future<bool> readyFuture;
+        bool readySet = false;
+        std::mutex readyMutex;
+        std::thread startThread;
+        std::shared_ptr<CircuitBreaker> loginBreaker;
+        std::shared_ptr<CircuitBreaker> connectBreaker; // shared by all connections
+        sigslot::signal<int> connectionCountChanged;
         std::unordered_map<std::string, std::string> variables;
         std::unordered_map<std::string, CloudClient::ListenMode> variablesListenMode;
         CloudClient::ListenMode defaultListenMode = CloudClient::ListenMode::CloudLog;
-        std::unordered_map<CloudConnection *, std::vector<std::pair<std::string, std::string>>> receivedMessages;
-        long cloudLogReadTime = 0;
+        ReceivedMessages receivedMessages;
+        std::set<CloudConnection *> readyConnections;
+        std::set<CloudConnection *> lostConnections;
+        std::set<CloudConnection *> slowConnections;
+        std::vector<CloudConnection *> rejoiningConnections;
+        std::shared_ptr<CloudLogPoller> cloudLogPoller; // use std::atomic_load() outside of the start thread and the listen threads
+        std::shared_ptr<CloudLogPoller::Subscription> cloudLogSubscription;
+        std::shared_ptr<CloudLogStore> cloudLogStore;
         TimePoint listenStartTime;
+        std::atomic<int> listenTime = 0;
+        std::unordered_map<CloudConnection *, TimePoint> slowSince;
         std::atomic<bool> listening = false;
-        TimePoint lastWsActivity;
+        std::atomic<TimePoint> lastWsActivity; // atomic, so that the cloud log thread doesn't need listenMutex
         TimePoint lastUpload;
         std::thread cloudLogThread;
         std::thread wsThread;
-        std::thread reconnectThread;
+        std::thread reloginThread;
+        std::mutex reloginMutex; // the thread isn't started while the client is being destroyed
+        std::thread maintenanceThread; // refreshes and resizes the pool
+        std::atomic<int> nextConnectionId = 0;
+        std::atomic<bool> maintaining = false;
+        std::atomic<bool> stopMaintenance = false;
+        std::atomic<bool> stopConnecting = false; // aborts logging in and connecting when the client is destroyed
+        TimePoint lastBusy;
+        TimePoint lastPoolCheck;
+        std::atomic<bool> relogging = false;
+        std::atomic<bool> listenersStarted = false;
+        std::shared_ptr<EventLoop> loop; // used instead of the threads if reactorThreads > 0
+        EventLoop::TimerId cloudLogTimer = 0;
+        EventLoop::TimerId wsTimer = 0;
         std::mutex listenMutex;
         std::atomic<bool> stopListenThreads = false;
+        AttributionMatcher attributions;
         sigslot::signal<const CloudEvent &> variableSet;
+        sigslot::signal<const CloudEvent &> variableAttributed;
 };
 
 } // namespace scratchcloud
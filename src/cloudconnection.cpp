@@ -1,38 +1,65 @@
 // SPDX-License-Identifier: MIT
 
-#include <iostream>
 #include <ixwebsocket/IXWebSocket.h>
 #include <nlohmann/json.hpp>
 
 #include "cloudconnection.h"
+#include "tracer.h"
+#include "clock.h"
+#include "logger.h"
 
-#define MAX_ATTEMPTS 32
 #define UPLOAD_WAIT_TIME 150
 #define CONNECTION_TIMEOUT 5000
 #define RESPONSE_TIMEOUT 5000
+#define UPLOAD_LOOP_INTERVAL 25
 
 using namespace scratchcloud;
 
-CloudConnection::CloudConnection(int id, const std::string &username, const std::string &sessionId, const std::string &projectId) :
+CloudConnection::CloudConnection(
+    int id,
+    const std::string &url,
+    const std::string &username,
+    const std::string &sessionId,
+    const std::string &projectId,
+    std::shared_ptr<EventLoop> loop,
+    const RetryPolicy &retryPolicy,
+    std::shared_ptr<CircuitBreaker> breaker,
+    int pingInterval,
+    bool ignoreHandshake,
+    const std::atomic<bool> *stop) :
     m_id(id),
     m_username(username),
     m_sessionId(sessionId),
-    m_projectId(projectId)
+    m_projectId(projectId),
+    m_loop(loop),
+    m_retryPolicy(retryPolicy),
+    m_breaker(breaker),
+    m_pingInterval(pingInterval)
 {
-    m_url = "wss://clouddata.scratch.mit.edu";
-    connect();
-
-    m_loopThread = std::thread([&]() { uploadLoop(); });
+    m_url = url;
+
+    // The response to the handshake contains all variables, which don't need to be read again if the client already knows them
+    m_ignoreNextMessage = ignoreHandshake;
+
+    // The owner can't close the connection before it's constructed, so it may abort the connection attempts instead
+    connect(stop ? stop : &m_stopLoop);
+
+    // Runs in another thread (or in the event loop) to send messages with a delay
+    if (m_loop)
+        m_uploadTimer = m_loop->scheduleRepeating(std::chrono::milliseconds(UPLOAD_LOOP_INTERVAL), [this]() { upload(); });
+    else {
+        m_loopThread = std::thread([this]() {
+            while (!m_stopLoop) {
+                upload();
+                Clock::sleepFor(std::chrono::milliseconds(UPLOAD_LOOP_INTERVAL));
+            }
+        });
+    }
 }
 
 CloudConnection::~CloudConnection()
 {
-    // Disconnect
-    m_stopLoop = true;
-    std::cout << m_id << ": disconnecting..." << std::endl;
-
-    if (m_loopThread.joinable())
-        m_loopThread.join();
+    close();
 }
 
 int CloudConnection::id() const
@@ -40,6 +67,29 @@ int CloudConnection::id() const
     return m_id;
 }
 
+void CloudConnection::close()
+{
+    if (m_stopLoop.exchange(true))
+        return;
+
+    SCRATCHCLOUD_LOG_INFO(m_id << ": disconnecting...");
+
+    if (m_loop)
+        m_loop->cancel(m_uploadTimer);
+
+    if (m_loopThread.joinable())
+        m_loopThread.join();
+
+    if (m_reconnectThread.joinable())
+        m_reconnectThread.join();
+
+    // Closing on purpose isn't a lost connection
+    m_connected = false;
+
+    if (m_websocket)
+        m_websocket->stop();
+}
+
 bool CloudConnection::connected() const
 {
     return m_connected;
@@ -54,28 +104,142 @@ int CloudConnection::queueSize() const
     return size;
 }
 
+int CloudConnection::queueDelay() const
+{
+    // The time the oldest queued message has been waiting for (in milliseconds)
+    std::lock_guard<std::mutex> lock(m_uploadMutex);
+
+    if (m_uploadQueue.empty())
+        return 0;
+
+    return std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - m_uploadQueue.front().enqueueTime).count();
+}
+
+int CloudConnection::latency() const
+{
+    std::lock_guard<std::mutex> lock(m_pingMutex);
+    int latency = std::max(0, m_rtt);
+
+    // A ping without response means that the connection is at least this slow
+    if (m_pingPending)
+        latency = std::max<int>(latency, std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - m_pingTime).count());
+
+    return latency;
+}
+
+int CloudConnection::healthScore() const
+{
+    // The estimated time (in milliseconds) until a new message reaches the server, lower is better
+    return queueSize() * UPLOAD_WAIT_TIME + latency() / 2;
+}
+
 void CloudConnection::uploadVar(const std::string &name, const std::string &value)
+{
+    uploadVar({ name, value, Clock::now() });
+}
+
+/*! Queues a request taken from another connection. It keeps its place among the queued requests by the time it was first queued. */
+void CloudConnection::uploadVar(const UploadRequest &request)
 {
     m_uploadMutex.lock();
-    m_uploadQueue.push_back({ name, value });
+    auto it = std::upper_bound(m_uploadQueue.begin(), m_uploadQueue.end(), request.enqueueTime, [](TimePoint time, const UploadRequest &queued) { return time < queued.enqueueTime; });
+    m_uploadQueue.insert(it, request);
     m_uploadMutex.unlock();
 }
 
+std::vector<CloudConnection::UploadRequest> CloudConnection::takeQueue()
+{
+    m_uploadMutex.lock();
+    std::vector<UploadRequest> queue(m_uploadQueue.begin(), m_uploadQueue.end());
+    m_uploadQueue.clear();
+    m_uploadMutex.unlock();
+
+    return queue;
+}
+
+void CloudConnection::setLatencyRecorder(LatencyRecorder *latency)
+{
+    m_latency = latency;
+}
+
+void CloudConnection::setMetrics(ConnectionMetrics *metrics)
+{
+    m_metrics = metrics;
+}
+
+void CloudConnection::setCapture(CaptureWriter *capture)
+{
+    m_capture = capture;
+}
+
+void CloudConnection::setSessionId(const std::string &sessionId)
+{
+    m_sessionMutex.lock();
+    m_sessionId = sessionId;
+    m_sessionMutex.unlock();
+}
+
+void CloudConnection::requestReconnect()
+{
+    // The reconnect happens in the upload loop
+    m_reconnect = true;
+}
+
 sigslot::signal<const std::string &, const std::string &> &CloudConnection::variableSet() const
 {
     return m_variableSet;
 }
 
-void CloudConnection::connect()
+sigslot::signal<> &CloudConnection::connectionLost() const
 {
-    if (m_attempt >= MAX_ATTEMPTS) {
-        std::cerr << m_id << ": failed to connect after " << m_attempt << " attempts, you should restart your server program now" << std::endl;
-        return;
+    return m_connectionLost;
+}
+
+sigslot::signal<> &CloudConnection::connectionRestored() const
+{
+    return m_connectionRestored;
+}
+
+sigslot::signal<> &CloudConnection::authenticationFailed() const
+{
+    return m_authenticationFailed;
+}
+
+void CloudConnection::connect(const std::atomic<bool> *stop)
+{
+    SCRATCHCLOUD_TRACE_SCOPE("connection", "connect");
+    Retry retry(m_retryPolicy, m_breaker.get());
+    m_authFailed = false;
+
+    bool success = retry.run(
+        [this](int) {
+            if (tryConnect())
+                return Retry::Result::Success;
+
+            // Another attempt with the same session ID wouldn't help
+            return m_authFailed ? Retry::Result::Fatal : Retry::Result::Failure;
+        },
+        stop);
+
+    if (success)
+        m_failedConnects = 0;
+    else if (m_authFailed) {
+        SCRATCHCLOUD_LOG_WARNING(m_id << ": the session has expired");
+        m_authenticationFailed();
+    } else if (!*stop) {
+        // Keep trying in the background (see upload())
+        int delay = retry.delay(++m_failedConnects);
+        m_nextConnect = Clock::now() + std::chrono::milliseconds(delay);
+        SCRATCHCLOUD_LOG_ERROR(m_id << ": failed to connect, trying again in " << delay << " ms");
     }
+}
 
-    m_attempt++;
-    assert(m_attempt <= MAX_ATTEMPTS);
+bool CloudConnection::tryConnect()
+{
+    m_responseMutex.lock();
     m_responseReceived = false;
+    m_handshakeFailed = false;
+    m_responseMutex.unlock();
     m_reconnect = false;
     m_websocket = std::make_shared<ix::WebSocket>();
     m_websocket->setUrl(m_url);
@@ -83,45 +247,56 @@ void CloudConnection::connect()
     // Message callback
     m_websocket->setOnMessageCallback([&](const ix::WebSocketMessagePtr &msg) {
         switch (msg->type) {
+            case ix::WebSocketMessageType::Pong:
+                processPong();
+                break;
+
             case ix::WebSocketMessageType::Close:
-                // Connection lost
-                if (m_connected) {
-                    m_connected = false;
+                if (m_connected.exchange(false)) {
+                    // Connection lost
                     m_reconnect = true;
-                    break;
+                    m_connectionLost();
+                } else {
+                    // Closed during the handshake
+                    m_responseMutex.lock();
+                    m_handshakeFailed = true;
+                    m_responseMutex.unlock();
+                    m_responseCond.notify_all();
                 }
 
+                break;
+
             case ix::WebSocketMessageType::Message: {
                 // Message received
+                m_responseMutex.lock();
                 m_responseReceived = true;
+                m_responseMutex.unlock();
+                m_responseCond.notify_all();
 
                 if (m_ignoreNextMessage) {
                     m_ignoreNextMessage = false;
                     return;
                 }
 
-                std::vector<std::string> response = splitStr(msg->str, "\n");
+                if (CaptureWriter *capture = m_capture)
+                    capture->write(CaptureRecord::Type::Frame, m_id, msg->str);
 
-                for (int i = 0; i < response.size() - 1; i++) {
-                    response[i].erase(response[i].find(u8"☁ "), 4);
+                SCRATCHCLOUD_TRACE_SCOPE("connection", "frame");
+                auto start = Clock::now();
+                std::vector<std::pair<std::string, std::string>> variables;
+                int errors = parseMessage(msg->str, variables);
 
-                    try {
-                        nlohmann::json json = nlohmann::json::parse(response[i]);
-                        std::string name = json["name"];
-                        std::string value;
-                        nlohmann::json jsonValue = json["value"];
+                if (ConnectionMetrics *metrics = m_metrics) {
+                    metrics->framesReceived++;
+                    metrics->parseErrors += errors;
+                }
 
-                        if (jsonValue.is_number())
-                            value = jsonValue.dump();
-                        else
-                            value = json["value"];
+                for (const auto &[name, value] : variables)
+                    m_variableSet(name, value);
+
+                if (LatencyRecorder *latency = m_latency)
+                    latency->record(LatencyStage::FrameReceive, start);
 
-                        m_variableSet(name, value);
-                    } catch (std::exception &e) {
-                        std::cerr << "invalid message JSON: " << response[i] << std::endl;
-                        std::cerr << e.what() << std::endl;
-                    }
-                }
                 break;
             }
 
@@ -132,7 +307,9 @@ void CloudConnection::connect()
 
     // Connect
     ix::WebSocketHttpHeaders extra_headers;
+    m_sessionMutex.lock();
     extra_headers["cookie"] = "scratchsessionsid=" + m_sessionId + ";";
+    m_sessionMutex.unlock();
     extra_headers["origin"] = "https://scratch.mit.edu";
     extra_headers["enable_multithread"] = true;
     m_websocket->setExtraHeaders(extra_headers);
@@ -141,72 +318,175 @@ void CloudConnection::connect()
     ix::WebSocketInitResult result = m_websocket->connect(CONNECTION_TIMEOUT / 1000);
 
     if (!result.success) {
-        // Failure
-        connect();
-        return;
+        if (result.http_status == 401 || result.http_status == 403)
+            m_authFailed = true;
+
+        return false;
     }
 
     // Handshake
+    SCRATCHCLOUD_TRACE_SCOPE("connection", "handshake");
     m_websocket->start();
-    m_websocket->send("{\"method\":\"handshake\", \"user\":\"" + m_username + "\", \"project_id\":\"" + m_projectId + "\" }\n");
+    m_websocket->send(handshakeMessage(m_username, m_projectId));
 
     // Wait for response with variable list
-    TimePoint start = std::chrono::steady_clock::now();
+    std::unique_lock<std::mutex> lock(m_responseMutex);
 
-    while (!m_responseReceived) {
-        std::this_thread::sleep_for(std::chrono::milliseconds(50));
-        auto now = std::chrono::steady_clock::now();
-        auto delta = std::chrono::duration_cast<std::chrono::milliseconds>(now - start).count();
-
-        if (delta > RESPONSE_TIMEOUT) {
-            m_websocket->close();
-            connect();
-            return;
-        }
+    if (!Clock::waitFor(m_responseCond, lock, std::chrono::milliseconds(RESPONSE_TIMEOUT), [this]() { return m_responseReceived || m_handshakeFailed; }) || !m_responseReceived) {
+        lock.unlock();
+        m_websocket->stop();
+        return false;
     }
 
-    m_attempt = 0;
+    lock.unlock();
+
+    m_pingMutex.lock();
+    m_pingPending = false;
+    m_rtt = -1;
+    m_pingMutex.unlock();
+
     m_connected = true;
+    return true;
 }
 
-void CloudConnection::uploadLoop()
+void CloudConnection::reconnect()
 {
-    // Runs in another thread to send messages with a delay
-    while (!m_stopLoop) {
-        if (m_reconnect) {
-            // Since we're reconnecting, we don't need to read the list of variables again
-            m_ignoreNextMessage = true;
-            m_attempt = 0;
-            m_websocket->close();
-            connect();
+    // Since we're reconnecting, we don't need to read the list of variables again
+    m_ignoreNextMessage = true;
+
+    if (ConnectionMetrics *metrics = m_metrics)
+        metrics->reconnects++;
+
+    m_websocket->stop(); // emits connectionLost() if the connection is still open
+    connect(&m_stopLoop);
+
+    if (m_connected)
+        m_connectionRestored();
+}
+
+void CloudConnection::upload()
+{
+    if (!m_connected && !m_reconnecting && m_failedConnects > 0 && Clock::now() >= m_nextConnect.load())
+        m_reconnect = true;
+
+    if (m_reconnect) {
+        if (!m_loop)
+            reconnect();
+        else if (!m_reconnecting) {
+            // Do not block the event loop
+            m_reconnecting = true;
+
+            if (m_reconnectThread.joinable())
+                m_reconnectThread.join();
+
+            m_reconnectThread = std::thread([this]() {
+                reconnect();
+                m_reconnecting = false;
+            });
         }
+    }
 
-        if (m_connected) {
-            m_uploadMutex.lock();
+    if (m_connected && m_pingInterval > 0)
+        ping();
 
-            if (!m_uploadQueue.empty()) {
-                auto now = std::chrono::steady_clock::now();
-                auto delta = std::chrono::duration_cast<std::chrono::milliseconds>(now - m_lastUpload).count();
+    if (m_connected) {
+        m_uploadMutex.lock();
 
-                if (delta >= UPLOAD_WAIT_TIME) {
-                    // Send queued message
-                    const auto &pair = m_uploadQueue.front();
+        if (!m_uploadQueue.empty()) {
+            auto now = Clock::now();
+            auto delta = std::chrono::duration_cast<std::chrono::milliseconds>(now - m_lastUpload).count();
 
-                    const auto &name = pair.first;
-                    const auto &value = pair.second;
-                    m_websocket->send(u8"{ \"method\":\"set\", \"name\":\"☁ " + name + "\", \"value\":\"" + value + "\", \"user\":\"" + m_username + "\", \"project_id\":\"" + m_projectId + "\" }\n");
-                    m_uploadQueue.erase(m_uploadQueue.begin());
-                    m_lastUpload = now;
-                }
-            }
+            if (delta >= UPLOAD_WAIT_TIME) {
+                // Send queued message
+                SCRATCHCLOUD_TRACE_SCOPE("connection", "upload");
+                const auto &request = m_uploadQueue.front();
 
-            m_uploadMutex.unlock();
+                const auto &name = request.name;
+                const auto &value = request.value;
+                m_websocket->send(setMessage(m_username, m_projectId, name, value));
+
+                if (LatencyRecorder *latency = m_latency)
+                    latency->record(LatencyStage::Send, request.enqueueTime);
+
+                if (ConnectionMetrics *metrics = m_metrics)
+                    metrics->messagesSent++;
+
+                m_uploadQueue.pop_front();
+                m_lastUpload = now;
+            }
         }
 
-        std::this_thread::sleep_for(std::chrono::milliseconds(25));
+        m_uploadMutex.unlock();
     }
 }
 
+void CloudConnection::ping()
+{
+    auto now = Clock::now();
+    std::unique_lock<std::mutex> lock(m_pingMutex);
+
+    // Only one ping at a time, so that the pong can be matched with it
+    if (m_pingPending || std::chrono::duration_cast<std::chrono::milliseconds>(now - m_pingTime).count() < m_pingInterval)
+        return;
+
+    m_pingPending = true;
+    m_pingTime = now;
+    lock.unlock();
+
+    m_websocket->ping("");
+}
+
+void CloudConnection::processPong()
+{
+    std::lock_guard<std::mutex> lock(m_pingMutex);
+
+    if (!m_pingPending)
+        return;
+
+    int rtt = std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - m_pingTime).count();
+    m_rtt = (m_rtt < 0) ? rtt : (7 * m_rtt + rtt) / 8;
+    m_pingPending = false;
+}
+
+/*! Reads the variables (name and value) from a message received from the server. Returns the number of invalid lines. */
+int CloudConnection::parseMessage(const std::string &message, std::vector<std::pair<std::string, std::string>> &out)
+{
+    std::vector<std::string> response = splitStr(message, "\n");
+    int errors = 0;
+
+    for (int i = 0; i < response.size() - 1; i++) {
+        try {
+            response[i].erase(response[i].find(u8"☁ "), 4);
+            nlohmann::json json = nlohmann::json::parse(response[i]);
+            std::string name = json["name"];
+            std::string value;
+            nlohmann::json jsonValue = json["value"];
+
+            if (jsonValue.is_number())
+                value = jsonValue.dump();
+            else
+                value = json["value"];
+
+            out.push_back({ name, value });
+        } catch (std::exception &e) {
+            SCRATCHCLOUD_LOG_WARNING("invalid message JSON: " << response[i] << ": " << e.what());
+            errors++;
+        }
+    }
+
+    return errors;
+}
+
+std::string CloudConnection::handshakeMessage(const std::string &username, const std::string &projectId)
+{
+    return "{\"method\":\"handshake\", \"user\":\"" + username + "\", \"project_id\":\"" + projectId + "\" }\n";
+}
+
+std::string CloudConnection::setMessage(const std::string &username, const std::string &projectId, const std::string &name, const std::string &value)
+{
+    return u8"{ \"method\":\"set\", \"name\":\"☁ " + name + "\", \"value\":\"" + value + "\", \"user\":\"" + username + "\", \"project_id\":\"" + projectId + "\" }\n";
+}
+
 std::vector<std::string> CloudConnection::splitStr(const std::string &str, const std::string &separator)
 {
     int start = 0;
@@ -5,10 +5,18 @@
 #include <string>
 #include <memory>
 #include <vector>
+#include <deque>
 #include <thread>
 #include <mutex>
+#include <atomic>
+#include <condition_variable>
 
 #include "signal.h"
+#include "eventloop.h"
+#include "retry.h"
+#include "latencyhistogram.h"
+#include "metrics.h"
+#include "capture.h"
 
 namespace ix
 {
@@ -21,41 +29,106 @@ namespace scratchcloud
 class CloudConnection
 {
     public:
-        CloudConnection(int id, const std::string &username, const std::string &sessionId, const std::string &projectId);
+        using TimePoint = std::chrono::steady_clock::time_point;
+
+        struct UploadRequest
+        {
+                std::string name;
+                std::string value;
+                TimePoint enqueueTime;
+        };
+
+        CloudConnection(
+            int id,
+            const std::string &url,
+            const std::string &username,
+            const std::string &sessionId,
+            const std::string &projectId,
+            std::shared_ptr<EventLoop> loop = nullptr,
+            const RetryPolicy &retryPolicy = RetryPolicy(),
+            std::shared_ptr<CircuitBreaker> breaker = nullptr,
+            int pingInterval = 0,
+            bool ignoreHandshake = false,
+            const std::atomic<bool> *stop = nullptr);
         ~CloudConnection();
 
         int id() const;
+        void close();
 
         bool connected() const;
 
         int queueSize() const;
+        int queueDelay() const;
+        int latency() const;
+        int healthScore() const;
         void uploadVar(const std::string &name, const std::string &value);
-        sigslot::signal<const std::string &, const std::string &> &variableSet() const;
+        void uploadVar(const UploadRequest &request);
+        std::vector<UploadRequest> takeQueue();
 
-    private:
-        using TimePoint = std::chrono::steady_clock::time_point;
+        void setLatencyRecorder(LatencyRecorder *latency);
+        void setMetrics(ConnectionMetrics *metrics);
+        void setCapture(CaptureWriter *capture);
+        void setSessionId(const std::string &sessionId);
+        void requestReconnect();
+
+        sigslot::signal<const std::string &, const std::string &> &variableSet() const;
+        sigslot::signal<> &connectionLost() const;
+        sigslot::signal<> &connectionRestored() const;
+        sigslot::signal<> &authenticationFailed() const;
 
-        void connect();
-        void uploadLoop();
+        static int parseMessage(const std::string &message, std::vector<std::pair<std::string, std::string>> &out);
+        static std::string handshakeMessage(const std::string &username, const std::string &projectId);
+        static std::string setMessage(const std::string &username, const std::string &projectId, const std::string &name, const std::string &value);
         static std::vector<std::string> splitStr(const std::string &str, const std::string &separator);
 
+    private:
+        void connect(const std::atomic<bool> *stop);
+        bool tryConnect();
+        void reconnect();
+        void upload();
+        void ping();
+        void processPong();
+
         int m_id;
         std::string m_username;
         std::string m_sessionId;
+        mutable std::mutex m_sessionMutex;
         std::string m_projectId;
         std::string m_url;
-        bool m_connected = false;
+        std::atomic<bool> m_connected = false;
         std::shared_ptr<ix::WebSocket> m_websocket;
-        int m_attempt = 0;
-        bool m_reconnect = false;
+        std::atomic<bool> m_reconnect = false;
+        std::atomic<bool> m_authFailed = false;
         bool m_responseReceived = false;
+        bool m_handshakeFailed = false;
+        std::mutex m_responseMutex;
+        std::condition_variable m_responseCond;
         bool m_ignoreNextMessage = false;
         std::thread m_loopThread;
-        bool m_stopLoop = false;
+        std::atomic<bool> m_stopLoop = false;
+        std::shared_ptr<EventLoop> m_loop;
+        EventLoop::TimerId m_uploadTimer = 0;
+        std::thread m_reconnectThread; // reconnects are blocking, so they don't run in the event loop
+        std::atomic<bool> m_reconnecting = false;
+        std::atomic<int> m_failedConnects = 0; // connects which ran out of attempts in a row
+        std::atomic<TimePoint> m_nextConnect;   // when to try again after a failed connect
+        RetryPolicy m_retryPolicy;
+        std::shared_ptr<CircuitBreaker> m_breaker; // shared by all connections of the client
+        std::atomic<LatencyRecorder *> m_latency = nullptr;
+        std::atomic<ConnectionMetrics *> m_metrics = nullptr;
+        std::atomic<CaptureWriter *> m_capture = nullptr;
+        int m_pingInterval;
+        mutable std::mutex m_pingMutex;
+        bool m_pingPending = false;
+        TimePoint m_pingTime;
+        int m_rtt = -1; // smoothed round-trip time, -1 if unknown
         mutable std::mutex m_uploadMutex;
-        std::vector<std::pair<std::string, std::string>> m_uploadQueue;
+        std::deque<UploadRequest> m_uploadQueue;
         TimePoint m_lastUpload;
         mutable sigslot::signal<const std::string &, const std::string &> m_variableSet;
+        mutable sigslot::signal<> m_connectionLost;
+        mutable sigslot::signal<> m_connectionRestored;
+        mutable sigslot::signal<> m_authenticationFailed;
 };
 
 } // namespace scratchcloud
@@ -1,9 +1,8 @@
 // SPDX-License-Identifier: MIT
 
-#include <iostream>
-
 #include "cloudevent.h"
 #include "cloudevent_p.h"
+#include "logger.h"
 
 using namespace scratchcloud;
 
@@ -12,10 +11,14 @@ CloudEvent::CloudEvent(CloudClient::ListenMode listenMode, const std::string &us
 {
 }
 
+/*!
+ * Returns the username of the user who set the variable.
+ * \note In Hybrid mode, the username is empty in events emitted by variableSet(). Use CloudClient::variableAttributed() or CloudClient::waitForUser() instead.
+ */
 const std::string &CloudEvent::user() const
 {
     if (impl->listenMode == CloudClient::ListenMode::Websockets) {
-        std::cerr << "Websockets mode doesn't support reading setter username! Use the CloudLog mode instead." << std::endl;
+        SCRATCHCLOUD_LOG_WARNING("Websockets mode doesn't support reading setter username! Use the CloudLog mode instead.");
         static const std::string empty;
         return empty;
     } else
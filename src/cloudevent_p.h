@@ -15,6 +15,7 @@ struct CloudEventPrivate
         std::string user;
         std::string name;
         std::string value;
+        unsigned long id = 0; // used to match Hybrid events with cloud log records
 };
 
 } // namespace scratchcloud
@@ -0,0 +1,80 @@
+// SPDX-License-Identifier: MIT
+
+#include <fstream>
+
+#include "cloudlogexporter.h"
+#include "cloudlogexporter_p.h"
+#include "logger.h"
+
+using namespace scratchcloud;
+
+/*! Constructs CloudLogExporter for the given project. */
+CloudLogExporter::CloudLogExporter(const std::string &projectId) :
+    impl(spimpl::make_unique_impl<CloudLogExporterPrivate>(projectId))
+{
+}
+
+/*! Returns the URL of the cloud log endpoint. */
+const std::string &CloudLogExporter::url() const
+{
+    return impl->url;
+}
+
+/*! Sets the URL of the cloud log endpoint (the default is the Scratch server). */
+void CloudLogExporter::setUrl(const std::string &newUrl)
+{
+    impl->url = newUrl;
+}
+
+/*! Returns the number of records requested at once. */
+int CloudLogExporter::pageSize() const
+{
+    return impl->pageSize;
+}
+
+/*! Sets the number of records requested at once (at least 2, consecutive pages overlap by one record). */
+void CloudLogExporter::setPageSize(int newPageSize)
+{
+    impl->pageSize = std::max(2, newPageSize);
+}
+
+/*! Returns the maximum number of pages downloaded concurrently. */
+int CloudLogExporter::parallelism() const
+{
+    return impl->parallelism;
+}
+
+/*! Sets the maximum number of pages downloaded concurrently. */
+void CloudLogExporter::setParallelism(int newParallelism)
+{
+    impl->parallelism = std::max(1, newParallelism);
+}
+
+/*! Returns the number of times a failed page request is retried. */
+int CloudLogExporter::maxRetries() const
+{
+    return impl->maxRetries;
+}
+
+/*! Sets the number of times a failed page request is retried. */
+void CloudLogExporter::setMaxRetries(int newMaxRetries)
+{
+    impl->maxRetries = std::max(0, newMaxRetries);
+}
+
+/*!
+ * Downloads the cloud log (at most maxRecords records, or all of them if maxRecords is 0)
+ * and writes it to the given file as JSON lines, starting with the newest record.
+ * Returns the number of written records or -1 if the download failed.
+ */
+long CloudLogExporter::exportToFile(const std::string &fileName, long maxRecords)
+{
+    std::ofstream file(fileName);
+
+    if (!file.is_open()) {
+        SCRATCHCLOUD_LOG_ERROR("failed to open " << fileName);
+        return -1;
+    }
+
+    return impl->exportLog(file, maxRecords);
+}
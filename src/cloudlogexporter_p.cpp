@@ -0,0 +1,213 @@
+// SPDX-License-Identifier: MIT
+
+#include <thread>
+#include <climits>
+#include <cpr/cpr.h>
+
+#include "cloudlogexporter_p.h"
+#include "cloudlogpoller.h"
+#include "logger.h"
+
+using namespace scratchcloud;
+
+CloudLogExporterPrivate::CloudLogExporterPrivate(const std::string &projectId) :
+    projectId(projectId),
+    url(CloudLogPoller::URL),
+    breaker(retryPolicy)
+{
+}
+
+long CloudLogExporterPrivate::exportLog(std::ostream &out, long maxRecords)
+{
+    // Consecutive pages overlap by one record, so that a page which doesn't continue the previous one can be detected
+    const int step = pageSize - 1;
+    nextPage = 0;
+    nextWrittenPage = 0;
+    endPage = maxRecords > 0 ? (maxRecords + step - 1) / step + 1 : INT_MAX;
+    failed = false;
+    pages.clear();
+    watermarkKeys.clear();
+
+    std::vector<std::thread> threads;
+
+    for (int i = 0; i < parallelism; i++)
+        threads.push_back(std::thread([this]() { downloadPages(); }));
+
+    // Write pages in order while the next pages are being downloaded
+    long count = 0;
+
+    while (true) {
+        std::unique_lock<std::mutex> lock(mutex);
+        cond.wait(lock, [this]() { return failed || nextWrittenPage >= endPage || pages.find(nextWrittenPage) != pages.cend(); });
+
+        if (failed || nextWrittenPage >= endPage)
+            break;
+
+        auto it = pages.find(nextWrittenPage);
+        std::vector<CloudLogRecord> page = std::move(it->second);
+        int pageIndex = nextWrittenPage;
+        pages.erase(it);
+        lock.unlock();
+
+        /*
+         * If the page was downloaded before the previous one and new records were added in between,
+         * the records which moved from the previous page to this one are in neither download.
+         * Downloading it again now closes the hole (new records can only cause duplicates then).
+         */
+        for (int attempt = 0; !isContiguous(page); attempt++) {
+            std::size_t entryCount = 0;
+
+            if (attempt >= maxRetries || !fetchPage(pageIndex, page, entryCount)) {
+                SCRATCHCLOUD_LOG_ERROR("cloud log page " << pageIndex << " doesn't continue the previous page");
+                lock.lock();
+                failed = true;
+                lock.unlock();
+                break;
+            }
+
+            if (entryCount < static_cast<std::size_t>(pageSize)) {
+                lock.lock();
+                endPage = std::min(endPage, pageIndex + 1);
+                lock.unlock();
+            }
+        }
+
+        lock.lock();
+
+        if (failed)
+            break;
+
+        nextWrittenPage++;
+        lock.unlock();
+        cond.notify_all();
+
+        // Skip records which were already written (new records shift older records to the next pages)
+        std::map<RecordKey, int> writtenKeys = watermarkKeys;
+        bool first = watermarkKeys.empty();
+
+        // Records in a page are ordered from the oldest one
+        for (auto recordIt = page.rbegin(); recordIt != page.rend(); recordIt++) {
+            const CloudLogRecord &record = *recordIt;
+            RecordKey key(record.timestamp(), record.user(), record.name(), record.value(), record.type());
+
+            if (!first && record.timestamp() > lowWatermark)
+                continue;
+
+            if (!first && record.timestamp() == lowWatermark && writtenKeys[key] > 0) {
+                writtenKeys[key]--;
+                continue;
+            }
+
+            if (maxRecords > 0 && count >= maxRecords)
+                break;
+
+            if (first || record.timestamp() < lowWatermark) {
+                lowWatermark = record.timestamp();
+                watermarkKeys.clear();
+                first = false;
+            }
+
+            watermarkKeys[key]++;
+
+            nlohmann::json json;
+            json["user"] = record.user();
+            json["verb"] = CloudLogRecord::verbFromType(record.type());
+            json["name"] = record.name();
+            json["value"] = record.value();
+            json["timestamp"] = record.timestamp();
+            out << json.dump() << '\n';
+            count++;
+        }
+    }
+
+    cond.notify_all();
+
+    for (auto &thread : threads)
+        thread.join();
+
+    out.flush();
+
+    if (failed) {
+        SCRATCHCLOUD_LOG_ERROR("failed to export cloud log");
+        return -1;
+    }
+
+    return count;
+}
+
+bool CloudLogExporterPrivate::isContiguous(const std::vector<CloudLogRecord> &page) const
+{
+    // The page must contain a written record (the overlap) or a newer one, unless nothing was written yet
+    if (watermarkKeys.empty() || page.empty())
+        return true;
+
+    const CloudLogRecord &newest = page.back();
+
+    if (newest.timestamp() > lowWatermark)
+        return true;
+    else if (newest.timestamp() < lowWatermark)
+        return false;
+
+    for (const CloudLogRecord &record : page) {
+        RecordKey key(record.timestamp(), record.user(), record.name(), record.value(), record.type());
+
+        if (watermarkKeys.find(key) != watermarkKeys.cend())
+            return true;
+    }
+
+    return false;
+}
+
+void CloudLogExporterPrivate::downloadPages()
+{
+    while (true) {
+        std::unique_lock<std::mutex> lock(mutex);
+
+        // Do not download too far ahead of the writer
+        cond.wait(lock, [this]() { return failed || nextPage >= endPage || nextPage < nextWrittenPage + parallelism * 2; });
+
+        if (failed || nextPage >= endPage)
+            return;
+
+        int page = nextPage++;
+        lock.unlock();
+
+        std::vector<CloudLogRecord> records;
+        std::size_t entryCount = 0;
+        bool success = fetchPage(page, records, entryCount);
+        lock.lock();
+
+        if (!success)
+            failed = true;
+        else {
+            // The last page isn't full (invalid records are skipped, so count the raw entries)
+            if (entryCount < static_cast<std::size_t>(pageSize))
+                endPage = std::min(endPage, page + 1);
+
+            pages[page] = std::move(records);
+        }
+
+        lock.unlock();
+        cond.notify_all();
+    }
+}
+
+bool CloudLogExporterPrivate::fetchPage(int page, std::vector<CloudLogRecord> &out, std::size_t &entryCount)
+{
+    // Each download thread has its own session, so that its connection is reused
+    static thread_local cpr::Session session;
+
+    RetryPolicy policy = retryPolicy;
+    policy.maxAttempts = maxRetries + 1;
+    Retry retry(policy, &breaker);
+
+    bool success = retry.run([this, page, &out, &entryCount](int) {
+        long readTime = 0;
+        return CloudLogPoller::fetch(session, url, projectId, out, readTime, pageSize, page * (pageSize - 1), nullptr, nullptr, &entryCount) ? Retry::Result::Success : Retry::Result::Failure;
+    });
+
+    if (!success)
+        SCRATCHCLOUD_LOG_ERROR("failed to download cloud log page " << page << " after " << maxRetries + 1 << " attempts");
+
+    return success;
+}
@@ -0,0 +1,53 @@
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <string>
+#include <map>
+#include <set>
+#include <tuple>
+#include <mutex>
+#include <condition_variable>
+#include <ostream>
+#include <vector>
+
+#include "cloudlogrecord.h"
+#include "retry.h"
+
+namespace scratchcloud
+{
+
+struct CloudLogExporterPrivate
+{
+        using RecordKey = std::tuple<long, std::string, std::string, std::string, CloudLogRecord::Type>;
+
+        CloudLogExporterPrivate(const std::string &projectId);
+
+        long exportLog(std::ostream &out, long maxRecords);
+        bool isContiguous(const std::vector<CloudLogRecord> &page) const;
+        void downloadPages();
+        bool fetchPage(int page, std::vector<CloudLogRecord> &out, std::size_t &entryCount);
+
+        std::string projectId;
+        std::string url;
+        int pageSize = 100;
+        int parallelism = 8;
+        int maxRetries = 5;
+        RetryPolicy retryPolicy;
+        CircuitBreaker breaker; // shared by all download threads
+
+        // Download state
+        int nextPage = 0;
+        int nextWrittenPage = 0;
+        int endPage = 0;
+        bool failed = false;
+        std::map<int, std::vector<CloudLogRecord>> pages;
+
+        // Written records: the oldest timestamp and how many records with each key have it
+        long lowWatermark = 0;
+        std::map<RecordKey, int> watermarkKeys;
+        std::mutex mutex;
+        std::condition_variable cond;
+};
+
+} // namespace scratchcloud
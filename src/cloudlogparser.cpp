@@ -0,0 +1,241 @@
+// SPDX-License-Identifier: MIT
+
+#include "cloudlogparser.h"
+#include "logger.h"
+
+using namespace scratchcloud;
+
+// Depth of the values inside of a record: [ { "key": value } ]
+#define RECORD_DEPTH 2
+
+CloudLogParser::CloudLogParser(std::vector<CloudLogRecord> &out, long readTime) :
+    m_out(out),
+    m_readTime(readTime)
+{
+}
+
+/*! Parses the given cloud log response and appends new records to the output vector (newest first). Returns false if the response is invalid. */
+bool CloudLogParser::parse(const std::string &text)
+{
+    m_maxTimestamp = 0;
+    m_stoppedEarly = false;
+    m_entryCount = 0;
+    m_error = false;
+    m_depth = 0;
+    resetRecord();
+
+    bool ret = nlohmann::json::sax_parse(text, this);
+
+    // Returning false from a callback to stop parsing isn't an error
+    return (ret || m_stoppedEarly) && !m_error;
+}
+
+/*! Returns the timestamp of the newest record. */
+long CloudLogParser::maxTimestamp() const
+{
+    return m_maxTimestamp;
+}
+
+/*! Returns true if parsing stopped at a record which was already read. */
+bool CloudLogParser::stoppedEarly() const
+{
+    return m_stoppedEarly;
+}
+
+/*! Returns the number of entries in the log array which were parsed, including invalid records. */
+std::size_t CloudLogParser::entryCount() const
+{
+    return m_entryCount;
+}
+
+bool CloudLogParser::null()
+{
+    return true;
+}
+
+bool CloudLogParser::boolean(bool)
+{
+    return true;
+}
+
+bool CloudLogParser::number_integer(nlohmann::json::number_integer_t val)
+{
+    return setNumber(std::to_string(val), val);
+}
+
+bool CloudLogParser::number_unsigned(nlohmann::json::number_unsigned_t val)
+{
+    return setNumber(std::to_string(val), val);
+}
+
+bool CloudLogParser::number_float(nlohmann::json::number_float_t val, const std::string &)
+{
+    // Use the same format as json::dump()
+    return setNumber(nlohmann::json(val).dump(), val);
+}
+
+bool CloudLogParser::string(std::string &val)
+{
+    if (m_depth != RECORD_DEPTH)
+        return true;
+
+    switch (m_field) {
+        case Field::User:
+            m_user = std::move(val);
+            m_hasUser = true;
+            break;
+
+        case Field::Verb:
+            m_verb = std::move(val);
+            m_hasVerb = true;
+            break;
+
+        case Field::Name:
+            m_name = std::move(val);
+            m_hasName = true;
+            break;
+
+        case Field::Value:
+            m_value = std::move(val);
+            m_hasValue = true;
+            break;
+
+        default:
+            break;
+    }
+
+    return true;
+}
+
+bool CloudLogParser::binary(nlohmann::json::binary_t &)
+{
+    return true;
+}
+
+bool CloudLogParser::start_object(std::size_t)
+{
+    m_depth++;
+
+    if (m_depth == 1) {
+        // The log must be an array of records
+        m_error = true;
+        return false;
+    }
+
+    if (m_depth == RECORD_DEPTH) {
+        m_entryCount++;
+        resetRecord();
+    }
+
+    return true;
+}
+
+bool CloudLogParser::end_object()
+{
+    m_depth--;
+
+    if (m_depth == RECORD_DEPTH - 1)
+        return finishRecord();
+
+    return true;
+}
+
+bool CloudLogParser::start_array(std::size_t)
+{
+    m_depth++;
+    return true;
+}
+
+bool CloudLogParser::end_array()
+{
+    m_depth--;
+    return true;
+}
+
+bool CloudLogParser::key(std::string &val)
+{
+    if (m_depth != RECORD_DEPTH)
+        return true;
+
+    if (val == "user")
+        m_field = Field::User;
+    else if (val == "verb")
+        m_field = Field::Verb;
+    else if (val == "name")
+        m_field = Field::Name;
+    else if (val == "value")
+        m_field = Field::Value;
+    else if (val == "timestamp")
+        m_field = Field::Timestamp;
+    else
+        m_field = Field::Unknown;
+
+    return true;
+}
+
+bool CloudLogParser::parse_error(std::size_t, const std::string &, const nlohmann::json::exception &ex)
+{
+    SCRATCHCLOUD_LOG_WARNING(ex.what());
+    m_error = true;
+    return false;
+}
+
+void CloudLogParser::resetRecord()
+{
+    m_field = Field::Unknown;
+    m_hasUser = false;
+    m_hasVerb = false;
+    m_hasName = false;
+    m_hasValue = false;
+    m_hasTimestamp = false;
+}
+
+bool CloudLogParser::setNumber(const std::string &str, long timestamp)
+{
+    if (m_depth != RECORD_DEPTH)
+        return true;
+
+    if (m_field == Field::Value) {
+        m_value = str;
+        m_hasValue = true;
+    } else if (m_field == Field::Timestamp) {
+        m_timestamp = timestamp;
+        m_hasTimestamp = true;
+    }
+
+    return true;
+}
+
+bool CloudLogParser::finishRecord()
+{
+    if (!m_hasUser || !m_hasVerb || !m_hasName || !m_hasValue || !m_hasTimestamp) {
+        SCRATCHCLOUD_LOG_WARNING("invalid cloud log record: missing fields");
+        return true;
+    }
+
+    CloudLogRecord::Type type = CloudLogRecord::typeFromVerb(m_verb);
+
+    if (type == CloudLogRecord::Type::Invalid) {
+        SCRATCHCLOUD_LOG_WARNING("invalid cloud log record type: " << m_verb);
+        return true;
+    }
+
+    auto index = m_name.find(u8"☁ ");
+
+    if (index == std::string::npos) {
+        SCRATCHCLOUD_LOG_WARNING("invalid cloud log record name: " << m_name);
+        return true;
+    }
+
+    m_name.erase(index, 4);
+    m_maxTimestamp = std::max(m_maxTimestamp, m_timestamp);
+
+    if (m_timestamp <= m_readTime) {
+        // The log is sorted from the newest record, so the remaining records were already read
+        m_stoppedEarly = true;
+        return false;
+    }
+
+    m_out.emplace_back(std::move(m_user), type, std::move(m_name), std::move(m_value), m_timestamp);
+    return true;
+}
@@ -0,0 +1,83 @@
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <vector>
+#include <nlohmann/json.hpp>
+
+#include "cloudlogrecord.h"
+
+namespace scratchcloud
+{
+
+/*!
+ * \brief The CloudLogParser class is a streaming (SAX) parser for cloud log responses.
+ *
+ * Records are emitted directly into the output vector without building a JSON DOM.
+ * Since the log is ordered from the newest record, parsing stops at the first record
+ * which isn't newer than the given read time.
+ */
+class CloudLogParser
+{
+    public:
+        CloudLogParser(std::vector<CloudLogRecord> &out, long readTime = 0);
+
+        bool parse(const std::string &text);
+
+        long maxTimestamp() const;
+        bool stoppedEarly() const;
+        std::size_t entryCount() const;
+
+        // SAX interface (see nlohmann::json_sax)
+        bool null();
+        bool boolean(bool val);
+        bool number_integer(nlohmann::json::number_integer_t val);
+        bool number_unsigned(nlohmann::json::number_unsigned_t val);
+        bool number_float(nlohmann::json::number_float_t val, const std::string &s);
+        bool string(std::string &val);
+        bool binary(nlohmann::json::binary_t &val);
+        bool start_object(std::size_t elements);
+        bool end_object();
+        bool start_array(std::size_t elements);
+        bool end_array();
+        bool key(std::string &val);
+        bool parse_error(std::size_t position, const std::string &last_token, const nlohmann::json::exception &ex);
+
+    private:
+        enum class Field
+        {
+            Unknown,
+            User,
+            Verb,
+            Name,
+            Value,
+            Timestamp
+        };
+
+        void resetRecord();
+        bool setNumber(const std::string &str, long timestamp);
+        bool finishRecord();
+
+        std::vector<CloudLogRecord> &m_out;
+        long m_readTime = 0;
+        long m_maxTimestamp = 0;
+        bool m_stoppedEarly = false;
+        std::size_t m_entryCount = 0;
+        bool m_error = false;
+        int m_depth = 0;
+        Field m_field = Field::Unknown;
+
+        // Fields of the record being parsed
+        std::string m_user;
+        std::string m_verb;
+        std::string m_name;
+        std::string m_value;
+        long m_timestamp = 0;
+        bool m_hasUser = false;
+        bool m_hasVerb = false;
+        bool m_hasName = false;
+        bool m_hasValue = false;
+        bool m_hasTimestamp = false;
+};
+
+} // namespace scratchcloud
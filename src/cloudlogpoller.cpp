@@ -0,0 +1,278 @@
+// SPDX-License-Identifier: MIT
+
+#include <unordered_map>
+#include <algorithm>
+#include <cpr/cpr.h>
+
+#include "cloudlogpoller.h"
+#include "cloudlogparser.h"
+#include "hostresolver.h"
+#include "tracer.h"
+#include "clock.h"
+#include "logger.h"
+
+#define LOG_UPDATE_INTERVAL 100
+#define LOG_IDLE_TIMEOUT 30000
+#define MAX_BUFFERED_RECORDS 1000
+
+using namespace scratchcloud;
+
+const std::string CloudLogPoller::URL = "https://clouddata.scratch.mit.edu/logs";
+
+static std::mutex registryMutex;
+static std::unordered_map<std::string, std::weak_ptr<CloudLogPoller>> registry;
+
+CloudLogPoller::CloudLogPoller(const std::string &projectId, const RetryPolicy &retryPolicy, const std::string &url) :
+    m_projectId(projectId),
+    m_url(url),
+    m_session(std::make_unique<cpr::Session>()),
+    m_retry(retryPolicy),
+    m_breaker(retryPolicy)
+{
+    m_thread = std::thread([this]() { pollLoop(); });
+}
+
+CloudLogPoller::~CloudLogPoller()
+{
+    m_stop = true;
+    m_cond.notify_all();
+
+    if (m_thread.joinable())
+        m_thread.join();
+}
+
+/*! Returns the poller of the given project on the given server. A new poller (using the given retry policy) is created if there isn't any. */
+std::shared_ptr<CloudLogPoller> CloudLogPoller::get(const std::string &projectId, const RetryPolicy &retryPolicy, const std::string &url)
+{
+    std::lock_guard<std::mutex> lock(registryMutex);
+    const std::string key = url + "?projectid=" + projectId;
+    auto it = registry.find(key);
+
+    if (it != registry.cend()) {
+        auto poller = it->second.lock();
+
+        if (poller)
+            return poller;
+    }
+
+    // Remove pollers which don't exist anymore
+    for (auto it = registry.begin(); it != registry.end();) {
+        if (it->second.expired())
+            it = registry.erase(it);
+        else
+            it++;
+    }
+
+    auto poller = std::make_shared<CloudLogPoller>(projectId, retryPolicy, url);
+    registry[key] = poller;
+    return poller;
+}
+
+/*! Creates a subscription which starts reading at the newest record. */
+std::shared_ptr<CloudLogPoller::Subscription> CloudLogPoller::subscribe()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto subscription = std::make_shared<Subscription>();
+    subscription->cursor = m_firstSeq + m_records.size();
+    subscription->lastActivity = Clock::now();
+    m_subscriptions.insert(subscription);
+
+    return subscription;
+}
+
+void CloudLogPoller::unsubscribe(const std::shared_ptr<Subscription> &subscription)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_subscriptions.erase(subscription);
+}
+
+/*! Waits for new records (the latest record is last) and moves the cursor of the subscription. Returns false if there aren't any new records. */
+bool CloudLogPoller::read(Subscription &subscription, std::vector<CloudLogRecord> &out, std::chrono::milliseconds timeout)
+{
+    out.clear();
+    std::unique_lock<std::mutex> lock(m_mutex);
+    Clock::waitFor(m_cond, lock, timeout, [this, &subscription]() { return m_stop || subscription.cursor < m_firstSeq + m_records.size(); });
+
+    if (subscription.cursor < m_firstSeq) {
+        SCRATCHCLOUD_LOG_WARNING("cloud log subscriber is too slow, skipped " << m_firstSeq - subscription.cursor << " records");
+        subscription.cursor = m_firstSeq;
+    }
+
+    const unsigned long end = m_firstSeq + m_records.size();
+
+    if (subscription.cursor >= end)
+        return false;
+
+    out.reserve(end - subscription.cursor);
+    out.insert(out.end(), m_records.begin() + (subscription.cursor - m_firstSeq), m_records.end());
+    subscription.cursor = end;
+
+    return true;
+}
+
+/*!
+ * Fetches records newer than readTime (the latest record is last) and updates readTime. Returns false if the request failed.
+ * The session is reused between requests, so that the TLS connection is kept alive.
+ */
+/*! Returns the latency of the requests of this poller (only the CloudLogFetch and CloudLogParse stages are recorded). */
+const LatencyRecorder &CloudLogPoller::latency() const
+{
+    return m_latency;
+}
+
+/*! Returns the number of cloud log requests made by this poller. */
+long CloudLogPoller::pollCount() const
+{
+    return m_polls;
+}
+
+/*! Returns the number of failed cloud log requests. */
+long CloudLogPoller::pollErrorCount() const
+{
+    return m_pollErrors;
+}
+
+/*! Returns the number of new records read from the cloud log. */
+long CloudLogPoller::recordCount() const
+{
+    return m_recordCount;
+}
+
+/*! Writes the responses to the given capture file (or stops writing them if it's null). */
+void CloudLogPoller::setCapture(std::shared_ptr<CaptureWriter> capture)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_capture = capture;
+}
+
+bool CloudLogPoller::fetch(
+    cpr::Session &session,
+    const std::string &logUrl,
+    const std::string &projectId,
+    std::vector<CloudLogRecord> &out,
+    long &readTime,
+    int limit,
+    int offset,
+    LatencyRecorder *latency,
+    CaptureWriter *capture,
+    std::size_t *entryCount)
+{
+    out.clear();
+
+    std::string url = logUrl;
+    url += "?projectid=";
+    url += projectId;
+    url += "&limit=";
+    url += std::to_string(limit);
+    url += "&offset=";
+    url += std::to_string(offset);
+    session.SetUrl(cpr::Url(url));
+    HostResolver::applyTo(session, url);
+    auto start = Clock::now();
+    cpr::Response response = session.Get();
+
+    if (latency)
+        latency->record(LatencyStage::CloudLogFetch, start);
+
+    SCRATCHCLOUD_TRACE_SINCE("cloudlog", "fetch", start);
+
+    if (response.status_code == 200) {
+        if (capture)
+            capture->write(CaptureRecord::Type::CloudLog, -1, response.text);
+
+        out.reserve(limit);
+        CloudLogParser parser(out, readTime);
+        start = Clock::now();
+        bool parsed = parser.parse(response.text);
+        SCRATCHCLOUD_TRACE_SINCE("cloudlog", "parse", start);
+
+        if (latency)
+            latency->record(LatencyStage::CloudLogParse, start);
+
+        if (parsed) {
+            readTime = std::max(readTime, parser.maxTimestamp());
+
+            if (entryCount)
+                *entryCount = parser.entryCount();
+
+            // We want the latest record to be last
+            std::reverse(out.begin(), out.end());
+            return true;
+        } else {
+            out.clear();
+            SCRATCHCLOUD_LOG_WARNING("invalid cloud log: " << response.text);
+        }
+    } else {
+        SCRATCHCLOUD_LOG_WARNING("failed to get cloud log: " << response.status_code);
+
+        // The cached address might be outdated
+        if (response.status_code == 0)
+            HostResolver::clear();
+    }
+
+    return false;
+}
+
+void CloudLogPoller::pollLoop()
+{
+    // Get initial log to avoid notifying about outdated events
+    std::vector<CloudLogRecord> log;
+    fetch(*m_session, m_url, m_projectId, log, m_readTime, 25, 0, &m_latency);
+    int failures = 0;
+
+    while (!m_stop) {
+        int interval = LOG_UPDATE_INTERVAL;
+
+        // Do not fetch log if there haven't been any WS messages recently
+        if (isActive() && m_breaker.waitUntilClosed(&m_stop)) {
+            m_polls++;
+
+            m_mutex.lock();
+            std::shared_ptr<CaptureWriter> capture = m_capture;
+            m_mutex.unlock();
+
+            if (fetch(*m_session, m_url, m_projectId, log, m_readTime, 25, 0, &m_latency, capture.get())) {
+                m_breaker.recordSuccess();
+                failures = 0;
+                m_recordCount += log.size();
+
+                if (!log.empty()) {
+                    std::lock_guard<std::mutex> lock(m_mutex);
+
+                    for (auto &record : log)
+                        m_records.push_back(std::move(record));
+
+                    while (m_records.size() > MAX_BUFFERED_RECORDS) {
+                        m_records.pop_front();
+                        m_firstSeq++;
+                    }
+
+                    m_cond.notify_all();
+                }
+            } else {
+                // Back off while the server is failing
+                m_pollErrors++;
+                m_breaker.recordFailure();
+                interval = std::max(interval, m_retry.delay(++failures));
+            }
+        }
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        Clock::waitFor(m_cond, lock, std::chrono::milliseconds(interval), [this]() { return m_stop.load(); });
+    }
+}
+
+bool CloudLogPoller::isActive()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto now = Clock::now();
+
+    for (auto subscription : m_subscriptions) {
+        auto delta = std::chrono::duration_cast<std::chrono::milliseconds>(now - subscription->lastActivity.load()).count();
+
+        if (delta < LOG_IDLE_TIMEOUT)
+            return true;
+    }
+
+    return false;
+}
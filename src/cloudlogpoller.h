@@ -0,0 +1,101 @@
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <string>
+#include <deque>
+#include <vector>
+#include <set>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+
+#include "cloudlogrecord.h"
+#include "retry.h"
+#include "latencyhistogram.h"
+#include "capture.h"
+
+namespace cpr
+{
+class Session;
+}
+
+namespace scratchcloud
+{
+
+/*!
+ * \brief The CloudLogPoller class fetches the cloud log of a project and fans the records out to subscribers.
+ *
+ * There's one poller per project in the process (see get()), so multiple clients
+ * connected to the same project share a single HTTP poll. Each subscriber has its own read cursor.
+ */
+class CloudLogPoller
+{
+    public:
+        using TimePoint = std::chrono::steady_clock::time_point;
+
+        struct Subscription
+        {
+                unsigned long cursor = 0; // sequence number of the next record to read
+                std::atomic<TimePoint> lastActivity;
+        };
+
+        CloudLogPoller(const std::string &projectId, const RetryPolicy &retryPolicy = RetryPolicy(), const std::string &url = URL);
+        CloudLogPoller(const CloudLogPoller &) = delete;
+        ~CloudLogPoller();
+
+        static const std::string URL;
+
+        static std::shared_ptr<CloudLogPoller> get(const std::string &projectId, const RetryPolicy &retryPolicy = RetryPolicy(), const std::string &url = URL);
+
+        std::shared_ptr<Subscription> subscribe();
+        void unsubscribe(const std::shared_ptr<Subscription> &subscription);
+        bool read(Subscription &subscription, std::vector<CloudLogRecord> &out, std::chrono::milliseconds timeout);
+
+        const LatencyRecorder &latency() const;
+        long pollCount() const;
+        long pollErrorCount() const;
+        long recordCount() const;
+
+        void setCapture(std::shared_ptr<CaptureWriter> capture);
+
+        static bool fetch(
+            cpr::Session &session,
+            const std::string &url,
+            const std::string &projectId,
+            std::vector<CloudLogRecord> &out,
+            long &readTime,
+            int limit = 25,
+            int offset = 0,
+            LatencyRecorder *latency = nullptr,
+            CaptureWriter *capture = nullptr,
+            std::size_t *entryCount = nullptr);
+
+    private:
+        void pollLoop();
+        bool isActive();
+
+        std::string m_projectId;
+        std::string m_url;
+        std::unique_ptr<cpr::Session> m_session; // keeps the connection alive between requests
+        Retry m_retry;
+        CircuitBreaker m_breaker;
+        LatencyRecorder m_latency;
+        std::atomic<long> m_polls = 0;
+        std::atomic<long> m_pollErrors = 0;
+        std::atomic<long> m_recordCount = 0;
+        std::shared_ptr<CaptureWriter> m_capture; // used with m_mutex locked
+        long m_readTime = 0;
+        std::deque<CloudLogRecord> m_records;
+        unsigned long m_firstSeq = 0; // sequence number of m_records.front()
+        std::set<std::shared_ptr<Subscription>> m_subscriptions;
+        std::thread m_thread;
+        std::atomic<bool> m_stop = false;
+        std::mutex m_mutex;
+        std::condition_variable m_cond;
+};
+
+} // namespace scratchcloud
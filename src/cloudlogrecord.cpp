@@ -1,6 +1,7 @@
 // SPDX-License-Identifier: MIT
 
 #include "cloudlogrecord.h"
+#include "logger.h"
 
 using namespace scratchcloud;
 
@@ -14,7 +15,7 @@ CloudLogRecord::CloudLogRecord(nlohmann::json json)
         auto it = RECORD_TYPES.find(json["verb"]);
 
         if (it == RECORD_TYPES.cend())
-            std::cerr << "invalid cloud log record type: " << json["verb"] << std::endl;
+            SCRATCHCLOUD_LOG_WARNING("invalid cloud log record type: " << json["verb"]);
         else
             m_type = it->second;
 
@@ -28,11 +29,19 @@ CloudLogRecord::CloudLogRecord(nlohmann::json json)
 
         m_timestamp = json["timestamp"];
     } catch (std::exception &e) {
-        std::cerr << "invalid cloud log record: " << json.dump();
-        std::cerr << e.what() << std::endl;
+        SCRATCHCLOUD_LOG_WARNING("invalid cloud log record: " << json.dump() << ": " << e.what());
     }
 }
 
+CloudLogRecord::CloudLogRecord(std::string user, Type type, std::string name, std::string value, long timestamp) :
+    m_user(std::move(user)),
+    m_type(type),
+    m_name(std::move(name)),
+    m_value(std::move(value)),
+    m_timestamp(timestamp)
+{
+}
+
 const std::string &CloudLogRecord::user() const
 {
     return m_user;
@@ -57,3 +66,24 @@ long CloudLogRecord::timestamp() const
 {
     return m_timestamp;
 }
+
+CloudLogRecord::Type CloudLogRecord::typeFromVerb(const std::string &verb)
+{
+    auto it = RECORD_TYPES.find(verb);
+
+    if (it == RECORD_TYPES.cend())
+        return Type::Invalid;
+
+    return it->second;
+}
+
+const std::string &CloudLogRecord::verbFromType(Type type)
+{
+    for (const auto &[verb, t] : RECORD_TYPES) {
+        if (t == type)
+            return verb;
+    }
+
+    static const std::string empty;
+    return empty;
+}
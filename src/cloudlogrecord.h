@@ -21,6 +21,7 @@ class CloudLogRecord
         };
 
         CloudLogRecord(nlohmann::json json);
+        CloudLogRecord(std::string user, Type type, std::string name, std::string value, long timestamp);
 
         const std::string &user() const;
         Type type() const;
@@ -28,6 +29,9 @@ class CloudLogRecord
         const std::string &value() const;
         long timestamp() const;
 
+        static Type typeFromVerb(const std::string &verb);
+        static const std::string &verbFromType(Type type);
+
     private:
         static const std::unordered_map<std::string, CloudLogRecord::Type> RECORD_TYPES;
         std::string m_user;
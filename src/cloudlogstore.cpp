@@ -0,0 +1,85 @@
+// SPDX-License-Identifier: MIT
+
+#include <algorithm>
+
+#include "cloudlogstore.h"
+#include "cloudlogstore_p.h"
+
+using namespace scratchcloud;
+
+/*! Opens the store in the given directory. The directory is created if it doesn't exist. */
+CloudLogStore::CloudLogStore(const std::string &directory) :
+    impl(spimpl::make_unique_impl<CloudLogStorePrivate>(directory))
+{
+}
+
+/*! Returns true if the store was opened successfully. */
+bool CloudLogStore::isOpen() const
+{
+    return impl->opened;
+}
+
+/*! Returns the number of records in the store. */
+long CloudLogStore::size() const
+{
+    std::shared_lock<std::shared_mutex> lock(impl->mutex);
+    return impl->rowCount;
+}
+
+/*!
+ * Appends the given records (the latest record is last) to the store.
+ * Records older than the latest stored record are skipped, and so are records which are already stored,
+ * so several clients can feed the same store.
+ */
+void CloudLogStore::append(const std::vector<Record> &records)
+{
+    std::unique_lock<std::shared_mutex> lock(impl->mutex);
+
+    if (!impl->opened)
+        return;
+
+    for (const Record &record : records)
+        impl->appendRecord(record.user, record.name, record.value, record.timestamp);
+
+    impl->sync();
+}
+
+/*! Returns all records with timestamps in the given range (inclusive). */
+std::vector<CloudLogStore::Record> CloudLogStore::query(long from, long to) const
+{
+    std::shared_lock<std::shared_mutex> lock(impl->mutex);
+    std::vector<Record> ret;
+
+    for (uint32_t row = impl->findRow(from); row < impl->rowCount; row++) {
+        if (impl->timestamp(row) > to)
+            break;
+
+        ret.push_back(impl->record(row));
+    }
+
+    return ret;
+}
+
+/*! Returns records of the given variable with timestamps in the given range (inclusive). */
+std::vector<CloudLogStore::Record> CloudLogStore::query(const std::string &name, long from, long to) const
+{
+    std::shared_lock<std::shared_mutex> lock(impl->mutex);
+    std::vector<Record> ret;
+    auto idIt = impl->stringIds.find(name);
+
+    if (idIt == impl->stringIds.cend())
+        return ret;
+
+    auto postingIt = impl->postings.find(idIt->second);
+
+    if (postingIt == impl->postings.cend())
+        return ret;
+
+    const std::vector<uint32_t> &rows = postingIt->second;
+    auto it = std::lower_bound(rows.begin(), rows.end(), from, [this](uint32_t row, long timestamp) { return impl->timestamp(row) < timestamp; });
+
+    for (; it != rows.end() && impl->timestamp(*it) <= to; it++)
+        ret.push_back(impl->record(*it));
+
+    return ret;
+}
@@ -0,0 +1,292 @@
+// SPDX-License-Identifier: MIT
+
+#include <filesystem>
+#include <algorithm>
+
+#include "cloudlogstore_p.h"
+#include "logger.h"
+
+#define SPARSE_INDEX_INTERVAL 64
+#define REMAP_MIN_ROWS        1024
+
+using namespace scratchcloud;
+
+CloudLogStorePrivate::CloudLogStorePrivate(const std::string &directory) :
+    directory(directory)
+{
+    opened = open();
+
+    if (!opened)
+        SCRATCHCLOUD_LOG_ERROR("failed to open cloud log store: " << directory);
+}
+
+bool CloudLogStorePrivate::open()
+{
+    std::error_code ec;
+    std::filesystem::create_directories(directory, ec);
+
+    if (ec || !loadStrings())
+        return false;
+
+    const std::filesystem::path dir(directory);
+    const std::string timestampsPath = (dir / "timestamps.bin").string();
+    const std::string usersPath = (dir / "users.bin").string();
+    const std::string namesPath = (dir / "names.bin").string();
+    const std::string valueIndexPath = (dir / "values.idx").string();
+    const std::string valueDataPath = (dir / "values.dat").string();
+
+    timestamps.map(timestampsPath);
+    users.map(usersPath);
+    names.map(namesPath);
+    valueIndex.map(valueIndexPath);
+    valueData.map(valueDataPath);
+
+    // Ignore incomplete rows (e.g. after a crash)
+    rowCount = std::min({ timestamps.size() / sizeof(int64_t), users.size() / sizeof(uint32_t), names.size() / sizeof(uint32_t), valueIndex.size() / sizeof(uint64_t) });
+
+    // Rows may refer to strings which didn't make it to the disk
+    for (uint32_t row = 0; row < rowCount; row++) {
+        if (users.as<uint32_t>()[row] >= strings.size() || names.as<uint32_t>()[row] >= strings.size()) {
+            rowCount = row;
+            break;
+        }
+    }
+
+    while (rowCount > 0 && valueIndex.as<uint64_t>()[rowCount - 1] > valueData.size())
+        rowCount--;
+
+    valueDataSize = rowCount > 0 ? valueIndex.as<uint64_t>()[rowCount - 1] : 0;
+
+    if (timestamps.size() != rowCount * sizeof(int64_t) || users.size() != rowCount * sizeof(uint32_t) || names.size() != rowCount * sizeof(uint32_t) || valueIndex.size() != rowCount * sizeof(uint64_t) ||
+        valueData.size() != valueDataSize) {
+        timestamps.unmap();
+        users.unmap();
+        names.unmap();
+        valueIndex.unmap();
+        valueData.unmap();
+
+        auto truncate = [&ec](const std::string &path, uintmax_t size) {
+            if (std::filesystem::exists(path))
+                std::filesystem::resize_file(path, size, ec);
+        };
+
+        truncate(timestampsPath, rowCount * sizeof(int64_t));
+        truncate(usersPath, rowCount * sizeof(uint32_t));
+        truncate(namesPath, rowCount * sizeof(uint32_t));
+        truncate(valueIndexPath, rowCount * sizeof(uint64_t));
+        truncate(valueDataPath, valueDataSize);
+
+        timestamps.map(timestampsPath);
+        users.map(usersPath);
+        names.map(namesPath);
+        valueIndex.map(valueIndexPath);
+        valueData.map(valueDataPath);
+    }
+
+    const auto mode = std::ios::binary | std::ios::app;
+    timestampsFile.open(timestampsPath, mode);
+    usersFile.open(usersPath, mode);
+    namesFile.open(namesPath, mode);
+    valueIndexFile.open(valueIndexPath, mode);
+    valueDataFile.open(valueDataPath, mode);
+    stringsFile.open((dir / "strings.bin").string(), mode);
+
+    if (!timestampsFile.is_open() || !usersFile.is_open() || !namesFile.is_open() || !valueIndexFile.is_open() || !valueDataFile.is_open() || !stringsFile.is_open())
+        return false;
+
+    mappedRows = rowCount;
+    mappedValueDataSize = valueDataSize;
+    buildIndex();
+    return true;
+}
+
+bool CloudLogStorePrivate::loadStrings()
+{
+    MappedFile file;
+    const std::string path = (std::filesystem::path(directory) / "strings.bin").string();
+
+    if (!file.map(path))
+        return true; // new store
+
+    std::size_t pos = 0;
+
+    while (pos + sizeof(uint32_t) <= file.size()) {
+        uint32_t length;
+        std::copy(file.data() + pos, file.data() + pos + sizeof(uint32_t), reinterpret_cast<char *>(&length));
+
+        if (pos + sizeof(uint32_t) + length > file.size())
+            break;
+
+        pos += sizeof(uint32_t);
+        stringIds[std::string(file.data() + pos, length)] = strings.size();
+        strings.emplace_back(file.data() + pos, length);
+        pos += length;
+    }
+
+    // Drop the incomplete string (e.g. after a crash), new strings are appended after it
+    if (pos != file.size()) {
+        file.unmap();
+        std::error_code ec;
+        std::filesystem::resize_file(path, pos, ec);
+
+        if (ec)
+            return false;
+    }
+
+    return true;
+}
+
+void CloudLogStorePrivate::buildIndex()
+{
+    sparseIndex.clear();
+    postings.clear();
+    const uint32_t *nameIds = names.as<uint32_t>();
+
+    for (uint32_t row = 0; row < rowCount; row++) {
+        if (row % SPARSE_INDEX_INTERVAL == 0)
+            sparseIndex.push_back({ timestamp(row), row });
+
+        postings[nameIds[row]].push_back(row);
+    }
+
+    lastTimestamp = rowCount > 0 ? timestamp(rowCount - 1) : 0;
+}
+
+uint32_t CloudLogStorePrivate::intern(const std::string &str)
+{
+    auto it = stringIds.find(str);
+
+    if (it != stringIds.cend())
+        return it->second;
+
+    uint32_t id = strings.size();
+    uint32_t length = str.size();
+    stringsFile.write(reinterpret_cast<const char *>(&length), sizeof(length));
+    stringsFile.write(str.data(), length);
+    strings.push_back(str);
+    stringIds[str] = id;
+
+    return id;
+}
+
+void CloudLogStorePrivate::appendRecord(const std::string &user, const std::string &name, const std::string &value, long timestamp)
+{
+    // Rows must be sorted by timestamp, and the same records may be fed again (e.g. by clients sharing a poller)
+    if (timestamp < lastTimestamp || (timestamp == lastTimestamp && isStored(user, name, value, timestamp)))
+        return;
+
+    const int64_t ts = timestamp;
+    const uint32_t userId = intern(user);
+    const uint32_t nameId = intern(name);
+    valueDataSize += value.size();
+
+    timestampsFile.write(reinterpret_cast<const char *>(&ts), sizeof(ts));
+    usersFile.write(reinterpret_cast<const char *>(&userId), sizeof(userId));
+    namesFile.write(reinterpret_cast<const char *>(&nameId), sizeof(nameId));
+    valueDataFile.write(value.data(), value.size());
+    valueIndexFile.write(reinterpret_cast<const char *>(&valueDataSize), sizeof(valueDataSize));
+
+    if (rowCount % SPARSE_INDEX_INTERVAL == 0)
+        sparseIndex.push_back({ timestamp, rowCount });
+
+    tailTimestamps.push_back(ts);
+    tailUsers.push_back(userId);
+    tailNames.push_back(nameId);
+    tailValueIndex.push_back(valueDataSize);
+    tailValueData.append(value);
+
+    postings[nameId].push_back(rowCount);
+    lastTimestamp = timestamp;
+    rowCount++;
+}
+
+bool CloudLogStorePrivate::isStored(const std::string &user, const std::string &name, const std::string &value, long timestamp) const
+{
+    // Only the last rows can have the timestamp
+    for (uint32_t row = rowCount; row > 0 && this->timestamp(row - 1) == timestamp; row--) {
+        CloudLogStore::Record stored = record(row - 1);
+
+        if (stored.user == user && stored.name == name && stored.value == value)
+            return true;
+    }
+
+    return false;
+}
+
+void CloudLogStorePrivate::sync()
+{
+    stringsFile.flush();
+    timestampsFile.flush();
+    usersFile.flush();
+    namesFile.flush();
+    valueIndexFile.flush();
+    valueDataFile.flush();
+
+    // Appended rows are read from memory, remap once they're as many as the mapped rows
+    if (tailTimestamps.size() < std::max<uint32_t>(mappedRows, REMAP_MIN_ROWS))
+        return;
+
+    const std::filesystem::path dir(directory);
+    timestamps.map((dir / "timestamps.bin").string());
+    users.map((dir / "users.bin").string());
+    names.map((dir / "names.bin").string());
+    valueIndex.map((dir / "values.idx").string());
+    valueData.map((dir / "values.dat").string());
+
+    // Keep the rows in memory if some of them couldn't be written
+    if (timestamps.size() != rowCount * sizeof(int64_t) || users.size() != rowCount * sizeof(uint32_t) || names.size() != rowCount * sizeof(uint32_t) || valueIndex.size() != rowCount * sizeof(uint64_t) ||
+        valueData.size() != valueDataSize)
+        return;
+
+    mappedRows = rowCount;
+    mappedValueDataSize = valueDataSize;
+    tailTimestamps.clear();
+    tailUsers.clear();
+    tailNames.clear();
+    tailValueIndex.clear();
+    tailValueData.clear();
+}
+
+long CloudLogStorePrivate::timestamp(uint32_t row) const
+{
+    return row < mappedRows ? timestamps.as<int64_t>()[row] : tailTimestamps[row - mappedRows];
+}
+
+uint64_t CloudLogStorePrivate::valueEnd(uint32_t row) const
+{
+    return row < mappedRows ? valueIndex.as<uint64_t>()[row] : tailValueIndex[row - mappedRows];
+}
+
+uint32_t CloudLogStorePrivate::findRow(long timestamp) const
+{
+    // Find the last indexed row before the timestamp and scan from there
+    auto it = std::lower_bound(sparseIndex.begin(), sparseIndex.end(), timestamp, [](const std::pair<long, uint32_t> &entry, long ts) { return entry.first < ts; });
+    uint32_t row = it == sparseIndex.begin() ? 0 : std::prev(it)->second;
+
+    while (row < rowCount && this->timestamp(row) < timestamp)
+        row++;
+
+    return row;
+}
+
+CloudLogStore::Record CloudLogStorePrivate::record(uint32_t row) const
+{
+    const uint64_t start = row > 0 ? valueEnd(row - 1) : 0;
+    const uint64_t length = valueEnd(row) - start;
+
+    CloudLogStore::Record ret;
+
+    if (row < mappedRows) {
+        ret.user = strings[users.as<uint32_t>()[row]];
+        ret.name = strings[names.as<uint32_t>()[row]];
+        ret.value = std::string(valueData.data() + start, length);
+    } else {
+        ret.user = strings[tailUsers[row - mappedRows]];
+        ret.name = strings[tailNames[row - mappedRows]];
+        ret.value = tailValueData.substr(start - mappedValueDataSize, length);
+    }
+
+    ret.timestamp = timestamp(row);
+
+    return ret;
+}
@@ -0,0 +1,76 @@
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <shared_mutex>
+#include <mutex>
+#include <fstream>
+#include <cstdint>
+
+#include "cloudlogstore.h"
+#include "mappedfile.h"
+
+namespace scratchcloud
+{
+
+struct CloudLogStorePrivate
+{
+        CloudLogStorePrivate(const std::string &directory);
+        CloudLogStorePrivate(const CloudLogStorePrivate &) = delete;
+
+        bool open();
+        bool loadStrings();
+        void buildIndex();
+        uint32_t intern(const std::string &str);
+        void appendRecord(const std::string &user, const std::string &name, const std::string &value, long timestamp);
+        bool isStored(const std::string &user, const std::string &name, const std::string &value, long timestamp) const;
+        void sync();
+
+        long timestamp(uint32_t row) const;
+        uint64_t valueEnd(uint32_t row) const;
+        uint32_t findRow(long timestamp) const;
+        CloudLogStore::Record record(uint32_t row) const;
+
+        std::string directory;
+        bool opened = false;
+        uint32_t rowCount = 0;
+        long lastTimestamp = 0;
+
+        // Columns (one value per row) and value data
+        std::ofstream timestampsFile; // int64_t
+        std::ofstream usersFile;      // uint32_t (string ID)
+        std::ofstream namesFile;      // uint32_t (string ID)
+        std::ofstream valueIndexFile; // uint64_t (end offset in value data)
+        std::ofstream valueDataFile;
+        std::ofstream stringsFile; // uint32_t length + data
+        MappedFile timestamps;
+        MappedFile users;
+        MappedFile names;
+        MappedFile valueIndex;
+        MappedFile valueData;
+        uint64_t valueDataSize = 0;
+
+        // Rows appended after the columns were last mapped
+        uint32_t mappedRows = 0;
+        uint64_t mappedValueDataSize = 0;
+        std::vector<int64_t> tailTimestamps;
+        std::vector<uint32_t> tailUsers;
+        std::vector<uint32_t> tailNames;
+        std::vector<uint64_t> tailValueIndex;
+        std::string tailValueData;
+
+        // Interned user and variable names
+        std::vector<std::string> strings;
+        std::unordered_map<std::string, uint32_t> stringIds;
+
+        // Indexes
+        std::vector<std::pair<long, uint32_t>> sparseIndex; // timestamp of every n-th row
+        std::unordered_map<uint32_t, std::vector<uint32_t>> postings; // rows of each variable
+
+        mutable std::shared_mutex mutex;
+};
+
+} // namespace scratchcloud
@@ -0,0 +1,153 @@
+// SPDX-License-Identifier: MIT
+
+#include <algorithm>
+
+#include "eventloop.h"
+#include "clock.h"
+
+using namespace scratchcloud;
+
+static std::mutex sharedMutex;
+static std::weak_ptr<EventLoop> sharedLoop;
+
+EventLoop::EventLoop(int threads)
+{
+    for (int i = 0; i < std::max(1, threads); i++)
+        m_threads.push_back(std::thread([this]() { run(); }));
+}
+
+EventLoop::~EventLoop()
+{
+    m_mutex.lock();
+    m_stop = true;
+    m_mutex.unlock();
+    m_cond.notify_all();
+
+    for (auto &thread : m_threads) {
+        if (thread.joinable())
+            thread.join();
+    }
+}
+
+/*! Returns the event loop shared by all clients in the process. The number of threads is only used when the loop is created. */
+std::shared_ptr<EventLoop> EventLoop::shared(int threads)
+{
+    std::lock_guard<std::mutex> lock(sharedMutex);
+    auto loop = sharedLoop.lock();
+
+    if (!loop) {
+        loop = std::make_shared<EventLoop>(threads);
+        sharedLoop = loop;
+    }
+
+    return loop;
+}
+
+int EventLoop::threadCount() const
+{
+    return m_threads.size();
+}
+
+/*! Runs the given task as soon as possible. */
+EventLoop::TimerId EventLoop::post(const Task &task)
+{
+    return add(std::chrono::milliseconds(0), std::chrono::milliseconds(0), task);
+}
+
+/*! Runs the given task once after the given delay. */
+EventLoop::TimerId EventLoop::schedule(std::chrono::milliseconds delay, const Task &task)
+{
+    return add(delay, std::chrono::milliseconds(0), task);
+}
+
+/*! Runs the given task repeatedly with the given interval until the timer is cancelled. */
+EventLoop::TimerId EventLoop::scheduleRepeating(std::chrono::milliseconds interval, const Task &task)
+{
+    return add(interval, std::max(interval, std::chrono::milliseconds(1)), task);
+}
+
+/*! Cancels the given timer and waits until it finishes if it's running. */
+void EventLoop::cancel(TimerId id)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    auto it = std::find_if(m_timers.begin(), m_timers.end(), [id](const Timer &timer) { return timer.id == id; });
+
+    if (it != m_timers.end()) {
+        m_timers.erase(it);
+        std::make_heap(m_timers.begin(), m_timers.end(), std::greater<Timer>());
+    }
+
+    auto runningIt = m_running.find(id);
+
+    if (runningIt != m_running.cend()) {
+        // Don't reschedule the timer after it finishes
+        m_cancelled.insert(id);
+
+        // Don't wait if the timer cancels itself
+        if (runningIt->second != std::this_thread::get_id())
+            m_finishedCond.wait(lock, [this, id]() { return m_running.find(id) == m_running.cend(); });
+    }
+}
+
+EventLoop::TimerId EventLoop::add(std::chrono::milliseconds delay, std::chrono::milliseconds interval, const Task &task)
+{
+    m_mutex.lock();
+    Timer timer;
+    timer.id = ++m_lastId;
+    timer.due = Clock::now() + delay;
+    timer.interval = interval;
+    timer.task = std::make_shared<Task>(task);
+    m_timers.push_back(std::move(timer));
+    std::push_heap(m_timers.begin(), m_timers.end(), std::greater<Timer>());
+    TimerId id = m_lastId;
+    m_mutex.unlock();
+    m_cond.notify_one();
+
+    return id;
+}
+
+void EventLoop::run()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    while (!m_stop) {
+        if (m_timers.empty()) {
+            m_cond.wait(lock);
+            continue;
+        }
+
+        auto now = Clock::now();
+
+        if (m_timers.front().due > now) {
+            Clock::waitUntil(m_cond, lock, m_timers.front().due);
+            continue;
+        }
+
+        std::pop_heap(m_timers.begin(), m_timers.end(), std::greater<Timer>());
+        Timer timer = std::move(m_timers.back());
+        m_timers.pop_back();
+        m_running[timer.id] = std::this_thread::get_id();
+
+        // Wake up another thread for the next timer
+        if (!m_timers.empty())
+            m_cond.notify_one();
+
+        lock.unlock();
+        (*timer.task)();
+        lock.lock();
+
+        m_running.erase(timer.id);
+        auto cancelledIt = m_cancelled.find(timer.id);
+
+        if (cancelledIt != m_cancelled.cend())
+            m_cancelled.erase(cancelledIt);
+        else if (timer.interval.count() > 0) {
+            // Fixed delay between runs, so that a slow timer doesn't run repeatedly to catch up
+            timer.due = Clock::now() + timer.interval;
+            m_timers.push_back(std::move(timer));
+            std::push_heap(m_timers.begin(), m_timers.end(), std::greater<Timer>());
+        }
+
+        m_finishedCond.notify_all();
+    }
+}
@@ -0,0 +1,69 @@
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <functional>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+#include <chrono>
+
+namespace scratchcloud
+{
+
+/*!
+ * \brief The EventLoop class runs timers of many connections on a small, fixed number of threads.
+ *
+ * A repeating timer never runs concurrently with itself. After cancel() returns,
+ * the timer isn't running and won't run again (unless cancel() is called from the timer itself).
+ */
+class EventLoop
+{
+    public:
+        using Task = std::function<void()>;
+        using TimerId = unsigned long;
+        using TimePoint = std::chrono::steady_clock::time_point;
+
+        EventLoop(int threads = 1);
+        EventLoop(const EventLoop &) = delete;
+        ~EventLoop();
+
+        static std::shared_ptr<EventLoop> shared(int threads);
+
+        int threadCount() const;
+
+        TimerId post(const Task &task);
+        TimerId schedule(std::chrono::milliseconds delay, const Task &task);
+        TimerId scheduleRepeating(std::chrono::milliseconds interval, const Task &task);
+        void cancel(TimerId id);
+
+    private:
+        struct Timer
+        {
+                TimerId id = 0;
+                TimePoint due;
+                std::chrono::milliseconds interval = std::chrono::milliseconds(0); // 0 for single shot timers
+                std::shared_ptr<Task> task;
+
+                bool operator>(const Timer &other) const { return due > other.due; }
+        };
+
+        TimerId add(std::chrono::milliseconds delay, std::chrono::milliseconds interval, const Task &task);
+        void run();
+
+        std::vector<std::thread> m_threads;
+        std::vector<Timer> m_timers; // min-heap by due time
+        std::unordered_set<TimerId> m_cancelled;
+        std::unordered_map<TimerId, std::thread::id> m_running;
+        TimerId m_lastId = 0;
+        bool m_stop = false;
+        std::mutex m_mutex;
+        std::condition_variable m_cond;
+        std::condition_variable m_finishedCond;
+};
+
+} // namespace scratchcloud
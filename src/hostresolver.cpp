@@ -0,0 +1,122 @@
+// SPDX-License-Identifier: MIT
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netdb.h>
+#include <arpa/inet.h>
+#endif
+
+#include <unordered_map>
+#include <mutex>
+#include <chrono>
+#include <cpr/cpr.h>
+
+#include "hostresolver.h"
+#include "clock.h"
+
+#define DNS_CACHE_TTL 300000 // 5 minutes
+
+using namespace scratchcloud;
+
+struct CacheEntry
+{
+        std::string address;
+        std::chrono::steady_clock::time_point expiration;
+};
+
+static std::mutex cacheMutex;
+static std::unordered_map<std::string, CacheEntry> cache;
+
+static std::string resolve(const std::string &host)
+{
+    addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo *result = nullptr;
+
+    if (getaddrinfo(host.c_str(), nullptr, &hints, &result) != 0)
+        return "";
+
+    std::string ret;
+    char buffer[INET6_ADDRSTRLEN];
+
+    // Prefer IPv4
+    for (int family : { AF_INET, AF_INET6 }) {
+        for (addrinfo *info = result; info && ret.empty(); info = info->ai_next) {
+            if (info->ai_family != family)
+                continue;
+
+            if (family == AF_INET && inet_ntop(AF_INET, &reinterpret_cast<sockaddr_in *>(info->ai_addr)->sin_addr, buffer, sizeof(buffer)))
+                ret = buffer;
+            else if (family == AF_INET6 && inet_ntop(AF_INET6, &reinterpret_cast<sockaddr_in6 *>(info->ai_addr)->sin6_addr, buffer, sizeof(buffer)))
+                ret = std::string("[") + buffer + "]";
+        }
+    }
+
+    freeaddrinfo(result);
+    return ret;
+}
+
+/*! Returns the host name in the given URL, e.g. clouddata.scratch.mit.edu in wss://clouddata.scratch.mit.edu. */
+std::string HostResolver::hostFromUrl(const std::string &url)
+{
+    std::string::size_type start = url.find("://");
+    start = start == std::string::npos ? 0 : start + 3;
+    std::string::size_type end = url.find_first_of(":/?", start);
+
+    return url.substr(start, end == std::string::npos ? std::string::npos : end - start);
+}
+
+/*! Returns the (cached) address of the given host, or an empty string if it couldn't be resolved. IPv6 addresses are enclosed in brackets. */
+std::string HostResolver::address(const std::string &host)
+{
+    auto now = Clock::now();
+
+    cacheMutex.lock();
+    auto it = cache.find(host);
+
+    if (it != cache.cend() && it->second.expiration > now) {
+        std::string ret = it->second.address;
+        cacheMutex.unlock();
+        return ret;
+    }
+
+    cacheMutex.unlock();
+
+    // Do not block other lookups while resolving
+    std::string ret = resolve(host);
+
+    if (!ret.empty()) {
+        std::lock_guard<std::mutex> lock(cacheMutex);
+        cache[host] = { ret, now + std::chrono::milliseconds(DNS_CACHE_TTL) };
+    }
+
+    return ret;
+}
+
+/*! Resolves the host of the given URL in another thread, so that connecting to it later doesn't wait for DNS. */
+std::future<std::string> HostResolver::prefetch(const std::string &url)
+{
+    return std::async(std::launch::async, [url]() { return address(hostFromUrl(url)); });
+}
+
+/*! Makes the given HTTP session use the cached address of the host of the given URL. */
+void HostResolver::applyTo(cpr::Session &session, const std::string &url)
+{
+    std::string host = hostFromUrl(url);
+    std::string addr = address(host);
+
+    if (!addr.empty())
+        session.SetResolve(cpr::Resolve(host, addr));
+}
+
+/*! Removes all cached addresses (e.g. after connection failures). */
+void HostResolver::clear()
+{
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    cache.clear();
+}
@@ -0,0 +1,32 @@
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <string>
+#include <future>
+
+namespace cpr
+{
+class Session;
+}
+
+namespace scratchcloud
+{
+
+/*!
+ * \brief The HostResolver class resolves host names of the servers.
+ *
+ * Resolved addresses are cached and shared by all connections in the process,
+ * so that reconnects and new HTTP requests don't have to wait for DNS.
+ */
+class HostResolver
+{
+    public:
+        static std::string hostFromUrl(const std::string &url);
+        static std::string address(const std::string &host);
+        static std::future<std::string> prefetch(const std::string &url);
+        static void applyTo(cpr::Session &session, const std::string &url);
+        static void clear();
+};
+
+} // namespace scratchcloud
@@ -0,0 +1,108 @@
+// SPDX-License-Identifier: MIT
+
+#include <climits>
+
+#include "latencyhistogram.h"
+#include "clock.h"
+
+using namespace scratchcloud;
+
+LatencyHistogram::LatencyHistogram() :
+    m_min(LONG_MAX)
+{
+    for (auto &bucket : m_buckets)
+        bucket.store(0, std::memory_order_relaxed);
+}
+
+void LatencyHistogram::record(long us)
+{
+    if (us < 0)
+        us = 0;
+
+    m_buckets[bucketIndex(us)].fetch_add(1, std::memory_order_relaxed);
+    m_count.fetch_add(1, std::memory_order_relaxed);
+    m_sum.fetch_add(us, std::memory_order_relaxed);
+
+    long min = m_min.load(std::memory_order_relaxed);
+
+    while (us < min && !m_min.compare_exchange_weak(min, us, std::memory_order_relaxed))
+        ;
+
+    long max = m_max.load(std::memory_order_relaxed);
+
+    while (us > max && !m_max.compare_exchange_weak(max, us, std::memory_order_relaxed))
+        ;
+}
+
+LatencySnapshot LatencyHistogram::snapshot() const
+{
+    // Values recorded while taking the snapshot may or may not be included
+    LatencySnapshot snapshot;
+
+    for (int i = 0; i < BUCKET_COUNT; i++) {
+        long n = m_buckets[i].load(std::memory_order_relaxed);
+
+        if (n > 0) {
+            snapshot.buckets.push_back({ bucketMax(i), n });
+            snapshot.count += n;
+        }
+    }
+
+    if (snapshot.count > 0) {
+        snapshot.min = m_min.load(std::memory_order_relaxed);
+        snapshot.max = m_max.load(std::memory_order_relaxed);
+        snapshot.mean = m_sum.load(std::memory_order_relaxed) / static_cast<double>(m_count.load(std::memory_order_relaxed));
+    }
+
+    return snapshot;
+}
+
+int LatencyHistogram::bucketIndex(unsigned long long value)
+{
+    if (value < SUB_BUCKETS)
+        return value;
+
+    // Position of the highest bit
+#if defined(__GNUC__) || defined(__clang__)
+    int exponent = 63 - __builtin_clzll(value);
+#else
+    int exponent = SUB_BUCKET_BITS;
+
+    while (value >> (exponent + 1))
+        exponent++;
+#endif
+
+    if (exponent > MAX_EXPONENT)
+        return BUCKET_COUNT - 1;
+
+    int sub = (value >> (exponent - SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1);
+    return SUB_BUCKETS + (exponent - SUB_BUCKET_BITS) * SUB_BUCKETS + sub;
+}
+
+long LatencyHistogram::bucketMax(int index)
+{
+    if (index < SUB_BUCKETS)
+        return index;
+
+    int exponent = (index - SUB_BUCKETS) / SUB_BUCKETS + SUB_BUCKET_BITS;
+    long sub = (index - SUB_BUCKETS) % SUB_BUCKETS;
+    long long width = 1LL << (exponent - SUB_BUCKET_BITS);
+
+    return (1LL << exponent) + (sub + 1) * width - 1;
+}
+
+void LatencyRecorder::record(LatencyStage stage, long us)
+{
+    m_histograms[static_cast<int>(stage)].record(us);
+}
+
+/*! Records the time elapsed since start. */
+void LatencyRecorder::record(LatencyStage stage, std::chrono::steady_clock::time_point start)
+{
+    record(stage, std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count());
+}
+
+LatencySnapshot LatencyRecorder::snapshot(LatencyStage stage) const
+{
+    return m_histograms[static_cast<int>(stage)].snapshot();
+}
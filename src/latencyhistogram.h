@@ -0,0 +1,58 @@
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <atomic>
+#include <array>
+#include <chrono>
+
+#include "latencysnapshot.h"
+
+namespace scratchcloud
+{
+
+/*!
+ * \brief The LatencyHistogram class records durations into logarithmic buckets.
+ *
+ * Each power of two is split into 16 linear sub-buckets (like HdrHistogram),
+ * so the relative error is at most 1/16. Recording only uses relaxed atomics,
+ * so it can be done from any thread without locking.
+ */
+class LatencyHistogram
+{
+    public:
+        LatencyHistogram();
+        LatencyHistogram(const LatencyHistogram &) = delete;
+
+        void record(long us);
+        LatencySnapshot snapshot() const;
+
+    private:
+        static constexpr int SUB_BUCKET_BITS = 4;
+        static constexpr int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+        static constexpr int MAX_EXPONENT = 40; // about 12 days in microseconds
+        static constexpr int BUCKET_COUNT = SUB_BUCKETS + (MAX_EXPONENT - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+        static int bucketIndex(unsigned long long value);
+        static long bucketMax(int index);
+
+        std::array<std::atomic<long>, BUCKET_COUNT> m_buckets;
+        std::atomic<long> m_count = 0;
+        std::atomic<long> m_sum = 0;
+        std::atomic<long> m_min;
+        std::atomic<long> m_max = 0;
+};
+
+/*! \brief The LatencyRecorder class holds a histogram for each LatencyStage. */
+class LatencyRecorder
+{
+    public:
+        void record(LatencyStage stage, long us);
+        void record(LatencyStage stage, std::chrono::steady_clock::time_point start);
+        LatencySnapshot snapshot(LatencyStage stage) const;
+
+    private:
+        std::array<LatencyHistogram, static_cast<int>(LatencyStage::CloudLogParse) + 1> m_histograms;
+};
+
+} // namespace scratchcloud
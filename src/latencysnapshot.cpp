@@ -0,0 +1,26 @@
+// SPDX-License-Identifier: MIT
+
+#include <algorithm>
+
+#include "latencysnapshot.h"
+
+using namespace scratchcloud;
+
+/*! Returns the value below which the given part (0 to 1) of the recorded values is, e.g. percentile(0.99). */
+long LatencySnapshot::percentile(double p) const
+{
+    if (count == 0)
+        return 0;
+
+    long rank = std::max(1L, static_cast<long>(p * count + 0.5));
+    long seen = 0;
+
+    for (const auto &[value, n] : buckets) {
+        seen += n;
+
+        if (seen >= rank)
+            return std::min(value, max);
+    }
+
+    return max;
+}
@@ -0,0 +1,220 @@
+// SPDX-License-Identifier: MIT
+
+#include <iostream>
+
+#include "logger.h"
+#include "clock.h"
+
+using namespace scratchcloud;
+
+std::atomic<int> Logger::m_level = static_cast<int>(LogLevel::Info);
+
+Logger::Logger() :
+    m_buffer(LOG_BUFFER_SIZE),
+    m_sink(defaultSink)
+{
+    for (size_t i = 0; i < m_buffer.size(); i++)
+        m_buffer[i].sequence.store(i, std::memory_order_relaxed);
+
+    m_thread = std::thread([this]() { run(); });
+}
+
+Logger::~Logger()
+{
+    // Write the remaining messages
+    m_stop = true;
+    m_cond.notify_all();
+
+    if (m_thread.joinable())
+        m_thread.join();
+}
+
+Logger &Logger::instance()
+{
+    static Logger logger;
+    return logger;
+}
+
+LogLevel Logger::level()
+{
+    return static_cast<LogLevel>(m_level.load());
+}
+
+void Logger::setLevel(LogLevel level)
+{
+    m_level = static_cast<int>(level);
+}
+
+/*! Queues a message. If the queue is full, the message is dropped. */
+void Logger::write(LogLevel level, std::string message, int suppressed)
+{
+    if (suppressed > 0)
+        message += " (" + std::to_string(suppressed) + " similar messages suppressed)";
+
+    if (!push(level, message))
+        m_dropped.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Logger::setSink(const Log::Sink &sink)
+{
+    std::lock_guard<std::mutex> lock(m_sinkMutex);
+    m_sink = sink ? sink : defaultSink;
+}
+
+/*! Waits until all messages queued before the call are written. */
+void Logger::flush()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    long request = ++m_flushRequested;
+    m_cond.notify_all();
+    m_flushCond.wait(lock, [this, request]() { return m_flushed >= request || m_stop; });
+}
+
+bool Logger::push(LogLevel level, std::string &message)
+{
+    // Bounded MPMC queue by Dmitry Vyukov: each entry has a sequence number which tells whether it's free or full
+    size_t pos = m_enqueuePos.load(std::memory_order_relaxed);
+    Entry *entry;
+
+    while (true) {
+        entry = &m_buffer[pos & (m_buffer.size() - 1)];
+        size_t sequence = entry->sequence.load(std::memory_order_acquire);
+        long diff = static_cast<long>(sequence) - static_cast<long>(pos);
+
+        if (diff == 0) {
+            if (m_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                break;
+        } else if (diff < 0)
+            return false; // full
+        else
+            pos = m_enqueuePos.load(std::memory_order_relaxed);
+    }
+
+    entry->level = level;
+    entry->message = std::move(message);
+    entry->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+}
+
+bool Logger::pop(LogLevel &level, std::string &message)
+{
+    Entry &entry = m_buffer[m_dequeuePos & (m_buffer.size() - 1)];
+
+    if (entry.sequence.load(std::memory_order_acquire) != m_dequeuePos + 1)
+        return false; // empty
+
+    level = entry.level;
+    message = std::move(entry.message);
+    entry.sequence.store(m_dequeuePos + m_buffer.size(), std::memory_order_release);
+    m_dequeuePos++;
+    return true;
+}
+
+void Logger::run()
+{
+    LogLevel level;
+    std::string message;
+
+    while (true) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        long request = m_flushRequested;
+        bool stop = m_stop;
+        lock.unlock();
+
+        std::unique_lock<std::mutex> sinkLock(m_sinkMutex);
+        bool written = false;
+
+        while (pop(level, message)) {
+            writeToSink(level, message);
+            written = true;
+        }
+
+        long dropped = m_dropped.exchange(0);
+
+        if (dropped > 0) {
+            writeToSink(LogLevel::Warning, std::to_string(dropped) + " log messages dropped");
+            written = true;
+        }
+
+        sinkLock.unlock();
+
+        if (written) {
+            std::cout.flush();
+            std::cerr.flush();
+        }
+
+        lock.lock();
+        m_flushed = request;
+        m_flushCond.notify_all();
+
+        if (stop)
+            break;
+
+        // Producers don't notify the writer (that would need a lock), so it checks the queue periodically.
+        // This uses real time, so that messages are written even if the time is virtual (see Clock).
+        m_cond.wait_for(lock, std::chrono::milliseconds(LOG_WRITE_INTERVAL), [this, request]() { return m_stop || m_flushRequested > request; });
+    }
+}
+
+void Logger::writeToSink(LogLevel level, const std::string &message)
+{
+    // The writer thread must survive exceptions of user sinks
+    try {
+        m_sink(level, message);
+    } catch (...) {
+    }
+}
+
+void Logger::defaultSink(LogLevel level, const std::string &message)
+{
+    // Flushed by the writer after each batch
+    if (level >= LogLevel::Warning)
+        std::cerr << message << '\n';
+    else
+        std::cout << message << '\n';
+}
+
+/*! Returns true if a message can be written. suppressed is set to the number of messages suppressed since the last allowed one. */
+bool LogRateLimiter::allow(int &suppressed)
+{
+    long long now = std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now().time_since_epoch()).count();
+    long long windowStart = m_windowStart.load(std::memory_order_relaxed);
+
+    if (now - windowStart >= LOG_RATE_WINDOW && m_windowStart.compare_exchange_strong(windowStart, now, std::memory_order_relaxed))
+        m_count.store(0, std::memory_order_relaxed);
+
+    if (m_count.fetch_add(1, std::memory_order_relaxed) < LOG_RATE_LIMIT) {
+        suppressed = m_suppressed.exchange(0, std::memory_order_relaxed);
+        return true;
+    }
+
+    m_suppressed.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+/*! Returns the minimum level of messages which are written. */
+LogLevel Log::level()
+{
+    return Logger::level();
+}
+
+/*! Sets the minimum level of messages which are written. The default is LogLevel::Info. */
+void Log::setLevel(LogLevel level)
+{
+    Logger::setLevel(level);
+}
+
+/*!
+ * Sets the function which writes log messages. It's called from a background thread.
+ * Use nullptr to write to stdout and stderr again.
+ */
+void Log::setSink(const Sink &sink)
+{
+    Logger::instance().setSink(sink);
+}
+
+/*! Waits until all messages logged so far are written. */
+void Log::flush()
+{
+    Logger::instance().flush();
+}
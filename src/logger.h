@@ -0,0 +1,109 @@
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <string>
+#include <sstream>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+#include "log.h"
+
+#define LOG_BUFFER_SIZE 4096 // must be a power of two
+#define LOG_WRITE_INTERVAL 10
+#define LOG_RATE_LIMIT 10 // messages per second from the same place
+#define LOG_RATE_WINDOW 1000
+
+// Formats and queues a message if the level is enabled and the call site isn't rate limited
+#define SCRATCHCLOUD_LOG(level, message) \
+    do { \
+        if (scratchcloud::Logger::enabled(level)) { \
+            static scratchcloud::LogRateLimiter logRateLimiter; \
+            int logSuppressed = 0; \
+            if (logRateLimiter.allow(logSuppressed)) { \
+                std::ostringstream logStream; \
+                logStream << message; \
+                scratchcloud::Logger::instance().write(level, logStream.str(), logSuppressed); \
+            } \
+        } \
+    } while (false)
+
+#define SCRATCHCLOUD_LOG_DEBUG(message) SCRATCHCLOUD_LOG(scratchcloud::LogLevel::Debug, message)
+#define SCRATCHCLOUD_LOG_INFO(message) SCRATCHCLOUD_LOG(scratchcloud::LogLevel::Info, message)
+#define SCRATCHCLOUD_LOG_WARNING(message) SCRATCHCLOUD_LOG(scratchcloud::LogLevel::Warning, message)
+#define SCRATCHCLOUD_LOG_ERROR(message) SCRATCHCLOUD_LOG(scratchcloud::LogLevel::Error, message)
+
+namespace scratchcloud
+{
+
+/*!
+ * \brief The Logger class passes log messages to a background writer thread.
+ *
+ * The messages are stored in a bounded lock-free queue (multiple producers, one consumer),
+ * so writing a message only takes a few atomic operations and never waits for the sink.
+ * Only use it through the SCRATCHCLOUD_LOG_* macros.
+ */
+class Logger
+{
+    public:
+        Logger(const Logger &) = delete;
+        ~Logger();
+
+        static Logger &instance();
+
+        static bool enabled(LogLevel level) { return static_cast<int>(level) >= m_level.load(std::memory_order_relaxed); }
+        static LogLevel level();
+        static void setLevel(LogLevel level);
+
+        void write(LogLevel level, std::string message, int suppressed = 0);
+        void setSink(const Log::Sink &sink);
+        void flush();
+
+    private:
+        struct Entry
+        {
+                std::atomic<size_t> sequence;
+                LogLevel level;
+                std::string message;
+        };
+
+        Logger();
+
+        bool push(LogLevel level, std::string &message);
+        bool pop(LogLevel &level, std::string &message);
+        void run();
+        void writeToSink(LogLevel level, const std::string &message);
+        static void defaultSink(LogLevel level, const std::string &message);
+
+        static std::atomic<int> m_level;
+        std::vector<Entry> m_buffer;
+        std::atomic<size_t> m_enqueuePos = 0;
+        size_t m_dequeuePos = 0; // only used by the writer thread
+        std::atomic<long> m_dropped = 0;
+        Log::Sink m_sink;
+        std::mutex m_sinkMutex;
+        std::thread m_thread;
+        std::atomic<bool> m_stop = false;
+        long m_flushRequested = 0;
+        long m_flushed = 0;
+        std::mutex m_mutex;
+        std::condition_variable m_cond;
+        std::condition_variable m_flushCond;
+};
+
+/*! \brief The LogRateLimiter class limits the number of messages from one call site per second. */
+class LogRateLimiter
+{
+    public:
+        bool allow(int &suppressed);
+
+    private:
+        std::atomic<long long> m_windowStart = 0;
+        std::atomic<int> m_count = 0;
+        std::atomic<int> m_suppressed = 0;
+};
+
+} // namespace scratchcloud
@@ -0,0 +1,93 @@
+// SPDX-License-Identifier: MIT
+
+#ifdef _WIN32
+#include <fstream>
+#include <sstream>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "mappedfile.h"
+
+using namespace scratchcloud;
+
+MappedFile::~MappedFile()
+{
+    unmap();
+}
+
+/*! Maps the given file. Returns false if the file couldn't be mapped. */
+bool MappedFile::map(const std::string &fileName)
+{
+    unmap();
+
+#ifdef _WIN32
+    std::ifstream file(fileName, std::ios::binary);
+
+    if (!file.is_open())
+        return false;
+
+    std::stringstream stream;
+    stream << file.rdbuf();
+    m_buffer = stream.str();
+    m_data = m_buffer.data();
+    m_size = m_buffer.size();
+    return true;
+#else
+    int fd = ::open(fileName.c_str(), O_RDONLY);
+
+    if (fd == -1)
+        return false;
+
+    struct stat st;
+
+    if (fstat(fd, &st) == -1) {
+        ::close(fd);
+        return false;
+    }
+
+    m_size = st.st_size;
+
+    // Empty files can't be mapped
+    if (m_size > 0) {
+        void *addr = mmap(nullptr, m_size, PROT_READ, MAP_SHARED, fd, 0);
+
+        if (addr == MAP_FAILED) {
+            ::close(fd);
+            m_size = 0;
+            return false;
+        }
+
+        m_data = static_cast<const char *>(addr);
+    }
+
+    ::close(fd);
+    return true;
+#endif
+}
+
+void MappedFile::unmap()
+{
+#ifdef _WIN32
+    m_buffer.clear();
+#else
+    if (m_data)
+        munmap(const_cast<char *>(m_data), m_size);
+#endif
+
+    m_data = nullptr;
+    m_size = 0;
+}
+
+const char *MappedFile::data() const
+{
+    return m_data;
+}
+
+std::size_t MappedFile::size() const
+{
+    return m_size;
+}
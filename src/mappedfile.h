@@ -0,0 +1,39 @@
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <string>
+#include <cstddef>
+
+namespace scratchcloud
+{
+
+/*! \brief The MappedFile class maps a file into memory for reading. */
+class MappedFile
+{
+    public:
+        MappedFile() = default;
+        MappedFile(const MappedFile &) = delete;
+        ~MappedFile();
+
+        bool map(const std::string &fileName);
+        void unmap();
+
+        const char *data() const;
+        std::size_t size() const;
+
+        template<typename T>
+        const T *as() const
+        {
+            return reinterpret_cast<const T *>(data());
+        }
+
+    private:
+        const char *m_data = nullptr;
+        std::size_t m_size = 0;
+#ifdef _WIN32
+        std::string m_buffer; // files are read into memory on Windows
+#endif
+};
+
+} // namespace scratchcloud
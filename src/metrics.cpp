@@ -0,0 +1,105 @@
+// SPDX-License-Identifier: MIT
+
+#include <sstream>
+#include <iomanip>
+#include <set>
+#include <cmath>
+
+#include "metrics.h"
+
+using namespace scratchcloud;
+
+void MetricsRegistry::addCounter(const std::string &name, const std::string &help, const std::atomic<long> *value)
+{
+    addCollector([name, help, value](std::vector<MetricSample> &out) { out.push_back({ name, help, MetricSample::Type::Counter, {}, static_cast<double>(value->load()) }); });
+}
+
+void MetricsRegistry::addGauge(const std::string &name, const std::string &help, std::function<double()> value)
+{
+    addCollector([name, help, value](std::vector<MetricSample> &out) { out.push_back({ name, help, MetricSample::Type::Gauge, {}, value() }); });
+}
+
+/*! Adds a function which adds any number of samples, e.g. one for each connection. */
+void MetricsRegistry::addCollector(const Collector &collector)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_collectors.push_back(collector);
+}
+
+std::vector<MetricSample> MetricsRegistry::collect() const
+{
+    std::vector<MetricSample> samples;
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    for (const auto &collector : m_collectors)
+        collector(samples);
+
+    return samples;
+}
+
+static std::string escapeLabel(const std::string &value)
+{
+    std::string out;
+
+    for (char c : value) {
+        if (c == '\\' || c == '"')
+            out += '\\';
+
+        if (c == '\n')
+            out += "\\n";
+        else
+            out += c;
+    }
+
+    return out;
+}
+
+static std::string formatValue(double value)
+{
+    if (std::isnan(value))
+        return "NaN";
+    else if (std::isinf(value))
+        return value > 0 ? "+Inf" : "-Inf";
+
+    // Counters can exceed the 6 significant digits of the default stream precision
+    if (value == std::trunc(value) && std::abs(value) < 1e18)
+        return std::to_string(static_cast<long long>(value));
+
+    std::ostringstream out;
+    out << std::setprecision(17) << value;
+    return out.str();
+}
+
+/*! Renders the samples in the Prometheus text exposition format. */
+std::string MetricsRegistry::toPrometheus(const std::vector<MetricSample> &samples)
+{
+    std::ostringstream out;
+    std::set<std::string> described;
+
+    for (const auto &sample : samples) {
+        // HELP and TYPE are written once for each metric
+        if (described.insert(sample.name).second) {
+            out << "# HELP " << sample.name << " " << sample.help << "\n";
+            out << "# TYPE " << sample.name << " " << (sample.type == MetricSample::Type::Counter ? "counter" : "gauge") << "\n";
+        }
+
+        out << sample.name;
+
+        if (!sample.labels.empty()) {
+            out << "{";
+
+            for (size_t i = 0; i < sample.labels.size(); i++) {
+                if (i > 0)
+                    out << ",";
+
+                out << sample.labels[i].first << "=\"" << escapeLabel(sample.labels[i].second) << "\"";
+            }
+
+            out << "}";
+        }
+
+        out << " " << formatValue(sample.value) << "\n";
+    }
+
+    return out.str();
+}
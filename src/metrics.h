@@ -0,0 +1,48 @@
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <vector>
+#include <mutex>
+
+#include "metricsample.h"
+
+namespace scratchcloud
+{
+
+/*!
+ * \brief The MetricsRegistry class collects the values of registered metrics on demand.
+ *
+ * Counters are plain atomics owned by the instrumented objects, so updating them
+ * doesn't involve the registry at all. Gauges are computed when the metrics are collected.
+ */
+class MetricsRegistry
+{
+    public:
+        using Collector = std::function<void(std::vector<MetricSample> &)>;
+
+        void addCounter(const std::string &name, const std::string &help, const std::atomic<long> *value);
+        void addGauge(const std::string &name, const std::string &help, std::function<double()> value);
+        void addCollector(const Collector &collector);
+
+        std::vector<MetricSample> collect() const;
+
+        static std::string toPrometheus(const std::vector<MetricSample> &samples);
+
+    private:
+        std::vector<Collector> m_collectors;
+        mutable std::mutex m_mutex;
+};
+
+/*! \brief The ConnectionMetrics struct holds the counters updated by connections. */
+struct ConnectionMetrics
+{
+        std::atomic<long> messagesSent = 0;
+        std::atomic<long> framesReceived = 0;
+        std::atomic<long> parseErrors = 0;
+        std::atomic<long> reconnects = 0;
+};
+
+} // namespace scratchcloud
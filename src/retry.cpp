@@ -0,0 +1,159 @@
+// SPDX-License-Identifier: MIT
+
+#include <random>
+#include <thread>
+#include <cmath>
+
+#include "retry.h"
+#include "clock.h"
+
+// Interval of checking the stop flag while waiting
+#define STOP_CHECK_INTERVAL 50
+
+using namespace scratchcloud;
+
+CircuitBreaker::CircuitBreaker(const RetryPolicy &policy) :
+    m_policy(policy)
+{
+}
+
+/*! Waits until an attempt is allowed. Returns false if it was stopped. */
+bool CircuitBreaker::waitUntilClosed(const std::atomic<bool> *stop)
+{
+    if (m_policy.circuitBreakerThreshold <= 0)
+        return true;
+
+    while (!stop || !*stop) {
+        m_mutex.lock();
+
+        if (!m_open) {
+            m_mutex.unlock();
+            return true;
+        }
+
+        auto now = Clock::now();
+        auto delta = std::chrono::duration_cast<std::chrono::milliseconds>(now - m_openedAt).count();
+
+        if (delta >= m_policy.circuitBreakerCooldown && !m_probing) {
+            // Let one attempt through
+            m_probing = true;
+            m_mutex.unlock();
+            return true;
+        }
+
+        m_mutex.unlock();
+        Clock::sleepFor(std::chrono::milliseconds(STOP_CHECK_INTERVAL));
+    }
+
+    return false;
+}
+
+void CircuitBreaker::recordSuccess()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_failures = 0;
+    m_open = false;
+    m_probing = false;
+}
+
+void CircuitBreaker::recordFailure()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_failures++;
+
+    if (m_probing || (m_policy.circuitBreakerThreshold > 0 && m_failures >= m_policy.circuitBreakerThreshold)) {
+        m_open = true;
+        m_probing = false;
+        m_openedAt = Clock::now();
+    }
+}
+
+/*! Lets another attempt through after the cooldown, if the attempt allowed by waitUntilClosed() didn't happen. */
+void CircuitBreaker::releaseProbe()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_probing = false;
+}
+
+bool CircuitBreaker::isOpen() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_open;
+}
+
+Retry::Retry(const RetryPolicy &policy, CircuitBreaker *breaker) :
+    m_policy(policy),
+    m_breaker(breaker)
+{
+}
+
+/*!
+ * Runs the given operation until it succeeds, fails fatally, runs out of attempts or is stopped.
+ * Returns true if the operation succeeded.
+ */
+bool Retry::run(const std::function<Result(int attempt)> &f, const std::atomic<bool> *stop)
+{
+    for (int attempt = 1; m_policy.maxAttempts <= 0 || attempt <= m_policy.maxAttempts; attempt++) {
+        if (m_breaker && !m_breaker->waitUntilClosed(stop))
+            return false;
+
+        if (stop && *stop) {
+            if (m_breaker)
+                m_breaker->releaseProbe();
+
+            return false;
+        }
+
+        Result result = f(attempt);
+
+        if (result == Result::Success) {
+            if (m_breaker)
+                m_breaker->recordSuccess();
+
+            return true;
+        }
+
+        if (m_breaker)
+            m_breaker->recordFailure();
+
+        if (result == Result::Fatal)
+            return false;
+
+        if (m_policy.maxAttempts > 0 && attempt >= m_policy.maxAttempts)
+            break;
+
+        if (!sleep(std::chrono::milliseconds(delay(attempt)), stop))
+            return false;
+    }
+
+    return false;
+}
+
+/*! Returns the delay (in milliseconds) after the given failed attempt. */
+int Retry::delay(int attempt) const
+{
+    double delay = m_policy.initialDelay * std::pow(m_policy.multiplier, std::max(0, attempt - 1));
+    delay = std::min(delay, static_cast<double>(m_policy.maxDelay));
+
+    thread_local std::mt19937 generator(std::random_device{}());
+    std::uniform_real_distribution<double> distribution(0, std::max(0.0, std::min(1.0, m_policy.jitter)));
+
+    return static_cast<int>(delay * (1 - distribution(generator)));
+}
+
+/*! Sleeps for the given time. Returns false if it was stopped. */
+bool Retry::sleep(std::chrono::milliseconds time, const std::atomic<bool> *stop)
+{
+    auto end = Clock::now() + time;
+
+    while (!stop || !*stop) {
+        auto now = Clock::now();
+
+        if (now >= end)
+            return true;
+
+        Clock::sleepFor(std::min(std::chrono::duration_cast<std::chrono::milliseconds>(end - now), std::chrono::milliseconds(STOP_CHECK_INTERVAL)));
+    }
+
+    return false;
+}
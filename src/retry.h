@@ -0,0 +1,65 @@
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <functional>
+
+#include "retrypolicy.h"
+
+namespace scratchcloud
+{
+
+/*!
+ * \brief The CircuitBreaker class pauses attempts of all users of an endpoint after too many consecutive failures.
+ *
+ * After the cooldown, a single attempt is let through. If it succeeds, the circuit closes again.
+ */
+class CircuitBreaker
+{
+    public:
+        using TimePoint = std::chrono::steady_clock::time_point;
+
+        CircuitBreaker(const RetryPolicy &policy);
+
+        bool waitUntilClosed(const std::atomic<bool> *stop = nullptr);
+        void recordSuccess();
+        void recordFailure();
+        void releaseProbe();
+        bool isOpen() const;
+
+    private:
+        RetryPolicy m_policy;
+        int m_failures = 0;
+        bool m_open = false;
+        bool m_probing = false; // an attempt is in progress after the cooldown
+        TimePoint m_openedAt;
+        mutable std::mutex m_mutex;
+};
+
+/*! \brief The Retry class runs an operation until it succeeds, with exponential backoff and jitter between attempts. */
+class Retry
+{
+    public:
+        enum class Result
+        {
+            Success,
+            Failure, /*!< The operation may be retried. */
+            Fatal    /*!< The operation must not be retried. */
+        };
+
+        Retry(const RetryPolicy &policy, CircuitBreaker *breaker = nullptr);
+
+        bool run(const std::function<Result(int attempt)> &f, const std::atomic<bool> *stop = nullptr);
+        int delay(int attempt) const;
+
+        static bool sleep(std::chrono::milliseconds time, const std::atomic<bool> *stop);
+
+    private:
+        RetryPolicy m_policy;
+        CircuitBreaker *m_breaker = nullptr;
+};
+
+} // namespace scratchcloud
@@ -0,0 +1,211 @@
+// SPDX-License-Identifier: MIT
+
+#include <fstream>
+#include <nlohmann/json.hpp>
+
+#include "tracer.h"
+#include "trace.h"
+#include "logger.h"
+
+using namespace scratchcloud;
+
+Tracer::Tracer() :
+    m_epoch(Clock::now()),
+    m_buffer(TRACE_BUFFER_SIZE)
+{
+}
+
+Tracer::~Tracer()
+{
+    m_mutex.lock();
+    m_stopAutoDump = true;
+    m_mutex.unlock();
+    m_autoDumpCond.notify_all();
+
+    if (m_autoDumpThread.joinable())
+        m_autoDumpThread.join();
+}
+
+Tracer &Tracer::instance()
+{
+    static Tracer tracer;
+    return tracer;
+}
+
+/*! Adds a span to the ring buffer and dumps the buffer if the span is longer than the auto dump threshold. */
+void Tracer::add(const char *category, const char *name, Clock::TimePoint start, Clock::TimePoint end)
+{
+    Event event;
+    event.category = category;
+    event.name = name;
+    event.thread = threadId();
+    event.start = std::chrono::duration_cast<std::chrono::microseconds>(start - m_epoch).count();
+    event.duration = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_buffer[m_next] = event;
+
+    if (++m_next == m_buffer.size()) {
+        m_next = 0;
+        m_full = true;
+    }
+
+    long threshold = m_autoDumpThreshold;
+
+    if (threshold <= 0 || event.duration < threshold || end - m_lastAutoDump < std::chrono::milliseconds(AUTO_DUMP_INTERVAL))
+        return;
+
+    // Let the following events in (e.g. the rest of the spike) while this one is dumped
+    m_lastAutoDump = end;
+    std::string fileName = m_autoDumpFile;
+    m_pendingAutoDump = fileName;
+
+    if (!m_autoDumpThread.joinable())
+        m_autoDumpThread = std::thread([this]() { runAutoDump(); });
+
+    lock.unlock();
+    m_autoDumpCond.notify_all();
+
+    SCRATCHCLOUD_LOG_WARNING("trace: " << name << " took " << event.duration << " us, writing " << fileName);
+}
+
+/*! Writes the events in the Chrome trace format. Returns false if the file couldn't be written. */
+bool Tracer::dump(const std::string &fileName)
+{
+    // Only one dump at a time
+    if (m_dumping.exchange(true))
+        return false;
+
+    nlohmann::json traceEvents = nlohmann::json::array();
+
+    for (const Event &event : events()) {
+        nlohmann::json json;
+        json["cat"] = event.category;
+        json["name"] = event.name;
+        json["ph"] = "X";
+        json["pid"] = 1;
+        json["tid"] = event.thread;
+        json["ts"] = event.start;
+        json["dur"] = event.duration;
+        traceEvents.push_back(std::move(json));
+    }
+
+    nlohmann::json root;
+    root["traceEvents"] = std::move(traceEvents);
+    root["displayTimeUnit"] = "ms";
+
+    std::ofstream file(fileName);
+    bool ret = false;
+
+    if (file.is_open()) {
+        file << root;
+        ret = file.good();
+    }
+
+    if (!ret)
+        SCRATCHCLOUD_LOG_ERROR("could not write trace to " << fileName);
+
+    m_dumping = false;
+    return ret;
+}
+
+void Tracer::setAutoDump(long threshold, const std::string &fileName)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_autoDumpThreshold = threshold;
+    m_autoDumpFile = fileName;
+    m_lastAutoDump = Clock::TimePoint();
+}
+
+void Tracer::clear()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_next = 0;
+    m_full = false;
+}
+
+int Tracer::threadId()
+{
+    // Small sequential IDs are easier to read in the trace viewer than native thread IDs
+    static std::atomic<int> nextId = 1;
+    thread_local int id = nextId++;
+    return id;
+}
+
+void Tracer::runAutoDump()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    while (true) {
+        m_autoDumpCond.wait(lock, [this]() { return m_stopAutoDump || !m_pendingAutoDump.empty(); });
+
+        if (m_stopAutoDump)
+            return;
+
+        std::string fileName = std::move(m_pendingAutoDump);
+        m_pendingAutoDump.clear();
+        lock.unlock();
+        dump(fileName);
+        lock.lock();
+    }
+}
+
+std::vector<Tracer::Event> Tracer::events() const
+{
+    // Returns the events from the oldest to the newest
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::vector<Event> ret;
+
+    if (m_full)
+        ret.insert(ret.end(), m_buffer.begin() + m_next, m_buffer.end());
+
+    ret.insert(ret.end(), m_buffer.begin(), m_buffer.begin() + m_next);
+    return ret;
+}
+
+/*! Returns true if the library was built with tracing. */
+bool Trace::enabled()
+{
+#ifdef SCRATCHCLOUDCLIENT_TRACING
+    return true;
+#else
+    return false;
+#endif
+}
+
+/*!
+ * Writes the recent events (up to 65536) to the given file in the Chrome trace format.
+ * Returns false if tracing is disabled or the file couldn't be written.
+ */
+bool Trace::dump(const std::string &fileName)
+{
+#ifdef SCRATCHCLOUDCLIENT_TRACING
+    return Tracer::instance().dump(fileName);
+#else
+    (void)fileName;
+    return false;
+#endif
+}
+
+/*!
+ * Automatically writes the trace to the given file when a span takes longer than
+ * threshold (in microseconds). The file is written at most once per 10 seconds.
+ * Use 0 to disable this.
+ */
+void Trace::setAutoDump(long threshold, const std::string &fileName)
+{
+#ifdef SCRATCHCLOUDCLIENT_TRACING
+    Tracer::instance().setAutoDump(threshold, fileName);
+#else
+    (void)threshold;
+    (void)fileName;
+#endif
+}
+
+/*! Removes all recorded events. */
+void Trace::clear()
+{
+#ifdef SCRATCHCLOUDCLIENT_TRACING
+    Tracer::instance().clear();
+#endif
+}
@@ -0,0 +1,110 @@
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <chrono>
+#include <vector>
+#include <string>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <condition_variable>
+
+#include "clock.h"
+
+#define TRACE_BUFFER_SIZE 65536
+#define AUTO_DUMP_INTERVAL 10000
+
+#ifdef SCRATCHCLOUDCLIENT_TRACING
+#define SCRATCHCLOUD_TRACE_CONCAT_(a, b) a##b
+#define SCRATCHCLOUD_TRACE_CONCAT(a, b) SCRATCHCLOUD_TRACE_CONCAT_(a, b)
+// Records a span from this line to the end of the scope
+#define SCRATCHCLOUD_TRACE_SCOPE(category, name) scratchcloud::TraceScope SCRATCHCLOUD_TRACE_CONCAT(traceScope, __LINE__)(category, name)
+// Records a span from the given time point (see Clock) to now
+#define SCRATCHCLOUD_TRACE_SINCE(category, name, start) scratchcloud::Tracer::instance().add(category, name, start, scratchcloud::Clock::now())
+#else
+#define SCRATCHCLOUD_TRACE_SCOPE(category, name) ((void)0)
+#define SCRATCHCLOUD_TRACE_SINCE(category, name, start) ((void)0)
+#endif
+
+namespace scratchcloud
+{
+
+/*!
+ * \brief The Tracer class holds the most recent trace events in a ring buffer.
+ *
+ * Only use it through the SCRATCHCLOUD_TRACE_* macros, so that tracing
+ * doesn't cost anything when it's compiled out.
+ */
+class Tracer
+{
+    public:
+        Tracer(const Tracer &) = delete;
+        ~Tracer();
+
+        static Tracer &instance();
+
+        void add(const char *category, const char *name, Clock::TimePoint start, Clock::TimePoint end);
+
+        bool dump(const std::string &fileName);
+        void setAutoDump(long threshold, const std::string &fileName);
+        void clear();
+
+    private:
+        // Names are string literals, so adding an event doesn't allocate
+        struct Event
+        {
+                const char *category = nullptr;
+                const char *name = nullptr;
+                int thread = 0;
+                long long start = 0; // microseconds since the creation of the tracer
+                long long duration = 0;
+        };
+
+        Tracer();
+
+        static int threadId();
+        std::vector<Event> events() const;
+        void runAutoDump();
+
+        const Clock::TimePoint m_epoch;
+        std::vector<Event> m_buffer;
+        size_t m_next = 0;
+        bool m_full = false;
+        mutable std::mutex m_mutex;
+        std::atomic<long> m_autoDumpThreshold = 0;
+        std::string m_autoDumpFile;
+        Clock::TimePoint m_lastAutoDump;
+        std::atomic<bool> m_dumping = false;
+
+        // Automatic dumps are written by a background thread, so that they don't delay the traced code
+        std::thread m_autoDumpThread;
+        std::condition_variable m_autoDumpCond;
+        std::string m_pendingAutoDump;
+        bool m_stopAutoDump = false;
+};
+
+#ifdef SCRATCHCLOUDCLIENT_TRACING
+/*! \brief The TraceScope class records a span from its construction to its destruction. */
+class TraceScope
+{
+    public:
+        TraceScope(const char *category, const char *name) :
+            m_category(category),
+            m_name(name),
+            m_start(Clock::now())
+        {
+        }
+
+        TraceScope(const TraceScope &) = delete;
+
+        ~TraceScope() { Tracer::instance().add(m_category, m_name, m_start, Clock::now()); }
+
+    private:
+        const char *m_category;
+        const char *m_name;
+        Clock::TimePoint m_start;
+};
+#endif
+
+} // namespace scratchcloud
@@ -0,0 +1,31 @@
+// SPDX-License-Identifier: MIT
+
+#include <scratchcloudclient/cloudlogexporter.h>
+#include <iostream>
+#include <chrono>
+
+using namespace scratchcloud;
+
+int main(int argc, char **argv)
+{
+    if (argc < 3) {
+        std::cerr << "usage: " << argv[0] << " <project ID> <output file> [max records] [parallelism]" << std::endl;
+        return 1;
+    }
+
+    CloudLogExporter exporter(argv[1]);
+    long maxRecords = argc > 3 ? std::stol(argv[3]) : 0;
+
+    if (argc > 4)
+        exporter.setParallelism(std::stoi(argv[4]));
+
+    auto start = std::chrono::steady_clock::now();
+    long count = exporter.exportToFile(argv[2], maxRecords);
+    auto delta = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+
+    if (count < 0)
+        return 1;
+
+    std::cout << "exported " << count << " records in " << delta << " ms" << std::endl;
+    return 0;
+}
@@ -0,0 +1,202 @@
+// SPDX-License-Identifier: MIT
+
+#include <scratchcloudclient/cloudclient.h>
+#include <scratchcloudclient/cloudevent.h>
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <random>
+#include <thread>
+#include <mutex>
+
+#include "cloudserver.h"
+
+#define SEQ_DIGITS 10
+#define DRIVER_TICK 5
+
+using namespace scratchcloud;
+using Clock = std::chrono::steady_clock;
+
+/*
+ * Simulates many Scratch players (peers) setting cloud variables and measures what
+ * a CloudClient connected to the same project receives. The peers are simulated
+ * inside the local stand-in server, so thousands of them don't need thousands of sockets.
+ */
+
+struct Config
+{
+        int peers = 1000;
+        double writeRate = 1; // per peer and second
+        int valueSize = SEQ_DIGITS;
+        int variables = 10;
+        int duration = 10; // seconds
+        int connections = 10;
+        int latency = 0;
+        double dropRate = 0;
+};
+
+static std::string makeValue(long seq, int size)
+{
+    // Padding followed by the zero-padded sequence number (cloud variables can only contain digits)
+    std::ostringstream stream;
+    stream << std::string(std::max(0, size - SEQ_DIGITS), '9') << std::setw(SEQ_DIGITS) << std::setfill('0') << seq;
+    return stream.str();
+}
+
+static long readSeq(const std::string &value)
+{
+    if (value.size() < SEQ_DIGITS)
+        return -1;
+
+    try {
+        return std::stol(value.substr(value.size() - SEQ_DIGITS));
+    } catch (std::exception &) {
+        return -1;
+    }
+}
+
+static double percentile(const std::vector<long> &sorted, double p)
+{
+    if (sorted.empty())
+        return 0;
+
+    size_t index = std::min(sorted.size() - 1, static_cast<size_t>(p * sorted.size()));
+    return sorted[index] / 1000.0;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc > 1 && (std::string(argv[1]) == "-h" || std::string(argv[1]) == "--help")) {
+        std::cout << "usage: " << argv[0] << " [peers] [writes per second per peer] [value size] [variables] [duration s] [connections] [server latency ms] [drop rate]" << std::endl;
+        return 0;
+    }
+
+    Config config;
+
+    try {
+        if (argc > 1)
+            config.peers = std::max(1, std::stoi(argv[1]));
+
+        if (argc > 2)
+            config.writeRate = std::stod(argv[2]);
+
+        if (argc > 3)
+            config.valueSize = std::max(SEQ_DIGITS, std::stoi(argv[3]));
+
+        if (argc > 4)
+            config.variables = std::max(1, std::stoi(argv[4]));
+
+        if (argc > 5)
+            config.duration = std::max(1, std::stoi(argv[5]));
+
+        if (argc > 6)
+            config.connections = std::max(1, std::stoi(argv[6]));
+
+        if (argc > 7)
+            config.latency = std::stoi(argv[7]);
+
+        if (argc > 8)
+            config.dropRate = std::stod(argv[8]);
+    } catch (std::exception &e) {
+        std::cerr << "invalid argument: " << e.what() << std::endl;
+        return 1;
+    }
+
+    CloudServerOptions serverOptions;
+    serverOptions.websocketPort = 19280;
+    serverOptions.httpPort = 19281;
+    serverOptions.latency = config.latency;
+    serverOptions.dropRate = config.dropRate;
+    serverOptions.variables = config.variables;
+    CloudServer server(serverOptions);
+
+    if (!server.start())
+        return 1;
+
+    // The client under test
+    CloudClientOptions options;
+    options.loginUrl = server.loginUrl();
+    options.websocketUrl = server.websocketUrl();
+    options.cloudLogUrl = server.cloudLogUrl();
+    options.connections = config.connections;
+    CloudClient client("loadgen", "password", "1", options);
+
+    if (!client.connected()) {
+        std::cerr << "the client failed to connect" << std::endl;
+        return 1;
+    }
+
+    client.setListenMode(CloudClient::ListenMode::Websockets);
+
+    const long expected = static_cast<long>(config.peers * config.writeRate * config.duration);
+    std::vector<Clock::time_point> sendTimes(expected);
+    std::vector<char> seen(expected, 0);
+    std::vector<long> latencies; // in microseconds
+    latencies.reserve(expected);
+    long duplicates = 0;
+    std::mutex mutex;
+
+    client.variableSet().connect([&](const CloudEvent &event) {
+        auto now = Clock::now();
+        long seq = readSeq(event.value());
+
+        if (seq < 0 || seq >= expected)
+            return;
+
+        std::lock_guard<std::mutex> lock(mutex);
+
+        if (seen[seq]) {
+            duplicates++;
+            return;
+        }
+
+        seen[seq] = 1;
+        latencies.push_back(std::chrono::duration_cast<std::chrono::microseconds>(now - sendTimes[seq]).count());
+    });
+
+    // Peers set variables at a constant total rate
+    std::cout << "simulating " << config.peers << " peers for " << config.duration << " s (" << expected << " writes)..." << std::endl;
+    std::mt19937 random(std::random_device{}());
+    std::uniform_int_distribution<int> peerDist(0, config.peers - 1);
+    std::uniform_int_distribution<int> varDist(0, config.variables - 1);
+    auto start = Clock::now();
+    long sent = 0;
+
+    while (sent < expected) {
+        double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+        long due = std::min(expected, static_cast<long>(elapsed * config.peers * config.writeRate));
+
+        for (; sent < due; sent++) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                sendTimes[sent] = Clock::now();
+            }
+
+            server.setVariable("1", "peer" + std::to_string(peerDist(random)), "var" + std::to_string(varDist(random)), makeValue(sent, config.valueSize));
+        }
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(DRIVER_TICK));
+    }
+
+    // Wait for the last messages
+    std::this_thread::sleep_for(std::chrono::seconds(2));
+    double total = std::chrono::duration<double>(Clock::now() - start).count();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    std::sort(latencies.begin(), latencies.end());
+    long received = latencies.size();
+    CloudServer::Stats stats = server.stats();
+
+    std::cout << "sent:        " << sent << std::endl;
+    std::cout << "received:    " << received << " (" << duplicates << " duplicates)" << std::endl;
+    std::cout << "throughput:  " << received / total << " events/s" << std::endl;
+    std::cout << "drop rate:   " << (sent > 0 ? 100.0 * (sent - received) / sent : 0) << " %" << std::endl;
+    std::cout << "server:      " << stats.delivered << " delivered, " << stats.dropped << " dropped" << std::endl;
+    std::cout << "latency p50: " << percentile(latencies, 0.5) << " ms" << std::endl;
+    std::cout << "latency p90: " << percentile(latencies, 0.9) << " ms" << std::endl;
+    std::cout << "latency p99: " << percentile(latencies, 0.99) << " ms" << std::endl;
+    std::cout << "latency max: " << (latencies.empty() ? 0 : latencies.back() / 1000.0) << " ms" << std::endl;
+
+    return 0;
+}
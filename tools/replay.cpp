@@ -0,0 +1,249 @@
+// SPDX-License-Identifier: MIT
+
+#include <scratchcloudclient/cloudevent.h>
+#include <iostream>
+#include <algorithm>
+#include <thread>
+#include <unordered_map>
+
+#include "cloudserver.h"
+#include "cloudclient_p.h"
+#include "cloudconnection.h"
+#include "cloudlogparser.h"
+#include "capture.h"
+
+#define DRAIN_TIMEOUT 5000
+
+using namespace scratchcloud;
+using Clock = std::chrono::steady_clock;
+
+/*
+ * Replays a capture (see CloudClientOptions::captureFile) through the parsing,
+ * reconciliation and dispatch code of a client. The client is connected to the
+ * local stand-in server, which doesn't send anything, so only the captured traffic
+ * is processed. Each captured connection is live from its first to its last message,
+ * and the live ones are assigned to the connections of the client, so that the same
+ * connections take part in the reconciliation as when the traffic was captured.
+ */
+
+static void printStage(const std::string &name, const LatencySnapshot &snapshot)
+{
+    std::cout << name << ": count " << snapshot.count << ", mean " << snapshot.mean << " us, p50 " << snapshot.percentile(0.5) << " us, p99 " << snapshot.percentile(0.99)
+              << " us, max " << snapshot.max << " us" << std::endl;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2 || std::string(argv[1]) == "-h" || std::string(argv[1]) == "--help") {
+        std::cout << "usage: " << argv[0] << " <capture file> [speed (1 = recorded, 0 = maximum)] [listen mode (ws, log, hybrid)]" << std::endl;
+        return argc < 2 ? 1 : 0;
+    }
+
+    double speed = 1;
+    CloudClient::ListenMode mode = CloudClient::ListenMode::Websockets;
+
+    try {
+        if (argc > 2)
+            speed = std::max(0.0, std::stod(argv[2]));
+    } catch (std::exception &e) {
+        std::cerr << "invalid argument: " << e.what() << std::endl;
+        return 1;
+    }
+
+    if (argc > 3) {
+        std::string modeStr = argv[3];
+
+        if (modeStr == "log")
+            mode = CloudClient::ListenMode::CloudLog;
+        else if (modeStr == "hybrid")
+            mode = CloudClient::ListenMode::Hybrid;
+        else if (modeStr != "ws") {
+            std::cerr << "invalid listen mode: " << modeStr << std::endl;
+            return 1;
+        }
+    }
+
+    // Read the whole capture first, so that disk reads don't affect the timing
+    CaptureReader reader(argv[1]);
+
+    if (!reader.isOpen())
+        return 1;
+
+    std::vector<CaptureRecord> records;
+    CaptureRecord record;
+    std::unordered_map<int, size_t> lastFrame; // index of the last message of each captured connection
+
+    while (reader.next(record)) {
+        if (record.type == CaptureRecord::Type::Frame)
+            lastFrame[record.source] = records.size();
+
+        records.push_back(std::move(record));
+    }
+
+    // The number of connections which were live at the same time
+    int connectionCount = 1;
+    int live = 0;
+    std::unordered_map<int, bool> seen;
+
+    for (size_t i = 0; i < records.size(); i++) {
+        if (records[i].type != CaptureRecord::Type::Frame)
+            continue;
+
+        if (!seen[records[i].source])
+            connectionCount = std::max(connectionCount, ++live);
+
+        seen[records[i].source] = true;
+
+        if (lastFrame[records[i].source] == i)
+            live--;
+    }
+
+    std::cout << "replaying " << records.size() << " records..." << std::endl;
+
+    CloudServerOptions serverOptions;
+    serverOptions.websocketPort = 19380;
+    serverOptions.httpPort = 19381;
+    CloudServer server(serverOptions);
+
+    if (!server.start())
+        return 1;
+
+    CloudClientOptions options;
+    options.loginUrl = server.loginUrl();
+    options.websocketUrl = server.websocketUrl();
+    options.cloudLogUrl = server.cloudLogUrl();
+    options.connections = connectionCount;
+    options.minConnections = connectionCount;
+    options.maxConnections = connectionCount;
+    options.pingInterval = 0;
+    CloudClientPrivate client("replay", "password", "1", options);
+
+    if (!client.connected) {
+        std::cerr << "the client failed to connect" << std::endl;
+        return 1;
+    }
+
+    client.listenMutex.lock();
+    client.defaultListenMode = mode;
+    client.listenMutex.unlock();
+
+    std::atomic<long> events = 0;
+    client.variableSet.connect([&events](const CloudEvent &) { events++; });
+
+    std::vector<CloudConnection *> connections;
+    client.connectionsMutex.lock();
+
+    for (const auto &conn : client.connections)
+        connections.push_back(conn.get());
+
+    client.connectionsMutex.unlock();
+    std::sort(connections.begin(), connections.end(), [](CloudConnection *a, CloudConnection *b) { return a->id() < b->id(); });
+
+    if (connections.empty()) {
+        std::cerr << "the client has no connections" << std::endl;
+        return 1;
+    }
+
+    // Connections join when their captured connection sends the first message
+    std::vector<CloudConnection *> freeConnections(connections.rbegin(), connections.rend());
+    std::unordered_map<int, CloudConnection *> liveConnections;
+    std::vector<CloudConnection *> leavingConnections;
+
+    for (CloudConnection *conn : connections)
+        client.removeReadyConnection(conn);
+
+    // A connection leaves after the messages it received in the current window are reconciled
+    auto leave = [&client, &freeConnections, &leavingConnections](bool wait) {
+        while (wait && client.listening)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+        if (client.listening)
+            return;
+
+        for (CloudConnection *conn : leavingConnections) {
+            client.removeReadyConnection(conn);
+            freeConnections.push_back(conn);
+        }
+
+        leavingConnections.clear();
+    };
+
+    LatencyRecorder parseLatency;
+    long frames = 0, logResponses = 0, parseErrors = 0;
+    long readTime = 0;
+    auto start = Clock::now();
+
+    for (size_t i = 0; i < records.size(); i++) {
+        const auto &record = records[i];
+
+        if (speed > 0)
+            std::this_thread::sleep_until(start + std::chrono::microseconds(static_cast<long long>(record.time / speed)));
+
+        leave(false);
+        auto parseStart = Clock::now();
+
+        if (record.type == CaptureRecord::Type::Frame) {
+            auto it = liveConnections.find(record.source);
+
+            if (it == liveConnections.end()) {
+                if (freeConnections.empty())
+                    leave(true);
+
+                it = liveConnections.insert({ record.source, freeConnections.back() }).first;
+                freeConnections.pop_back();
+                client.addReadyConnection(it->second);
+            }
+
+            // The same path as CloudConnection
+            std::vector<std::pair<std::string, std::string>> variables;
+            parseErrors += CloudConnection::parseMessage(record.data, variables);
+            parseLatency.record(LatencyStage::FrameReceive, parseStart);
+            CloudConnection *conn = it->second;
+
+            for (const auto &[name, value] : variables)
+                client.processEvent(conn, name, value);
+
+            if (lastFrame[record.source] == i) {
+                leavingConnections.push_back(conn);
+                liveConnections.erase(it);
+            }
+
+            frames++;
+        } else if (record.type == CaptureRecord::Type::CloudLog) {
+            // The same path as CloudLogPoller
+            std::vector<CloudLogRecord> log;
+            CloudLogParser parser(log, readTime);
+
+            if (parser.parse(record.data)) {
+                readTime = std::max(readTime, parser.maxTimestamp());
+                std::reverse(log.begin(), log.end());
+                parseLatency.record(LatencyStage::CloudLogParse, parseStart);
+                client.processCloudLog(log);
+            } else
+                parseErrors++;
+
+            logResponses++;
+        }
+    }
+
+    // Wait until the last messages are dispatched
+    auto drainStart = Clock::now();
+
+    while (client.listening && Clock::now() - drainStart < std::chrono::milliseconds(DRAIN_TIMEOUT))
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+    double total = std::chrono::duration<double>(Clock::now() - start).count();
+
+    std::cout << "frames:        " << frames << std::endl;
+    std::cout << "log responses: " << logResponses << std::endl;
+    std::cout << "parse errors:  " << parseErrors << std::endl;
+    std::cout << "events:        " << events << " (" << client.echoFiltered << " filtered)" << std::endl;
+    std::cout << "time:          " << total << " s (" << events / total << " events/s)" << std::endl;
+    printStage("frame parse", parseLatency.snapshot(LatencyStage::FrameReceive));
+    printStage("log parse", parseLatency.snapshot(LatencyStage::CloudLogParse));
+    printStage("reconciliation", client.latency.snapshot(LatencyStage::Reconciliation));
+    printStage("dispatch", client.latency.snapshot(LatencyStage::Dispatch));
+    printStage("slots", client.latency.snapshot(LatencyStage::SlotComplete));
+
+    return 0;
+}